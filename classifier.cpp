@@ -24,6 +24,8 @@
 #include "utility.hpp"
 #include "utility_vector.hpp"
 #include "utility_classifier.hpp"
+#include "utility_idf_dic.hpp"
+#include "utility_w_vector.hpp"
 
 using namespace std;
 
@@ -47,7 +49,7 @@ static inline void vector_size_fn(unsigned int size)
 }
 
 string word;
-static inline void string_partial_fn(char *str)
+static inline void string_partial_fn(const char *str)
 {
   word.append(str);
 }
@@ -91,14 +93,25 @@ static inline void load_profile_file(char *filename)
 	       end_of_vector_fn);
 }
 
+/* With the option -W, the w vectors are raw (see w_to_vector -t) and are
+ * weighted using the IDF_DIC as they are loaded
+ */
+static const char *idf_dic_path = NULL;
+static class_idf_dic idf_dic;
+static class_w_vector_weighting weighting;
+
 static inline void vector_size_fn_dot(unsigned int size)
 {
   if (size != vector_size) {
     fatal_error("w vector and W vector have different sizes");
   }
+  if (idf_dic_path != NULL && size != idf_dic.size()) {
+    fatal_error("Raw w vector size (%u) != IDF_DIC size (%lu)",
+		size, static_cast<unsigned long>(idf_dic.size()));
+  }
 }
 
-static inline void string_partial_fn_dot(char *str)
+static inline void string_partial_fn_dot(const char *str)
 {
   word.append(str);
 }
@@ -114,11 +127,19 @@ static inline void offset_count_fn_dot(unsigned int count)
 static class_sparse_vector w;
 static inline void double_fn_dot(unsigned int index, double value)
 {
-  w[index] = value;
+  if (idf_dic_path != NULL) {
+    weighting.add(index, value);
+  } else {
+    w[index] = value;
+  }
 }
 
 static inline void end_of_vector_fn_dot(void)
 {
+  if (idf_dic_path != NULL) {
+    weighting.output(w);
+  }
+
   for (class_classifier_list::const_iterator i = classifier_list.begin();
        i != classifier_list.end();
        i++)
@@ -180,9 +201,13 @@ MAIN_BEGIN(
 "If a document is classified into L categories, DOC_NAME will be duplicated L\n"
 "times once for each category into which the document is classified.\n"
 "The result is output to the given file if an output file is specified, or to\n"
-"stdout otherwise.\n",
-"D:",
-"-D PROFILE_FILE",
+"stdout otherwise.\n"
+"If the option -W is given, the w vectors in the input stream are expected to\n"
+"be raw w vectors output by the w_to_vector processing unit with the option\n"
+"-t, and they are weighted using IDF_DIC_FILE as they are loaded like the\n"
+"rocchio processing unit does with the option -W.\n",
+"D:W:",
+"-D PROFILE_FILE [-W IDF_DIC_FILE]",
 0,
 case 'D':
 /* Allocating tokenizing buffer */
@@ -195,11 +220,20 @@ profile_file_name = optarg;
 /* End of allocation */
 break;
 
+case 'W':
+idf_dic_path = optarg;
+break;
+
 ) {
   if (buffer == NULL) {
     fatal_error("-D must be specified (-h for help)");
   }
 
+  if (idf_dic_path != NULL) {
+    idf_dic.open(idf_dic_path, buffer, BUFFER_SIZE);
+    weighting.init(&idf_dic);
+  }
+
   load_profile_file(profile_file_name);
   if (classifier_list.size() == 0) {
     fatal_error("Cannot carry out dot product: PROFILE file is empty");
@@ -0,0 +1,59 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Usage: content_dedup.sh TEMP_DIR [COPY_COUNT=4] [ROUND_COUNT=3]
+
+. ../roi_fixture.sh
+setup_roi_fixture "$1" doc
+
+copy_count=${2:-4}
+round_count=${3:-3}
+
+# Each document is written as text, and then it is copied under
+# COPY_COUNT - 1 other names like a mirrored web page.
+write_roi_documents doc text || exit 1
+for doc in `ls doc`; do
+    for ((copy = 1; copy < copy_count; copy++)); do
+	cp doc/$doc doc/$doc.$copy || exit 1
+    done
+done
+ls doc | sort | sed "s%^%$PWD/doc/%" > doc.txt
+
+TIMEFORMAT=%R
+echo -e "ROUND\ttf\ttf -u\tvectorize\tvectorize -u"
+for ((round = 1; round <= round_count; round++)); do
+    tf_all=`{ time $exec_dir/tf -b -C tf_1.bin doc.txt ; } 2>&1` || exit 1
+    tf_unique=`{ time $exec_dir/tf -b -u -C tf_2.bin doc.txt ; } 2>&1` \
+	|| exit 1
+    vectorize_all=`{ time $exec_dir/vectorize -D idf_dic_1.bin -o w_1.bin \
+	tf_1.bin ; } 2>&1` || exit 1
+    vectorize_unique=`{ time $exec_dir/vectorize -u -D idf_dic_2.bin \
+	-o w_2.bin tf_2.bin ; } 2>&1` || exit 1
+    echo -e "$round\t$tf_all\t$tf_unique\t$vectorize_all\t$vectorize_unique"
+done
+
+if cmp -s tf_1.bin tf_2.bin && cmp -s idf_dic_1.bin idf_dic_2.bin \
+    && cmp -s w_1.bin w_2.bin; then
+    echo "The results are the same"
+else
+    echo "The results differ" >&2
+    exit 1
+fi
+
+exit 0
@@ -0,0 +1,81 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Usage: feature_order.sh TEMP_DIR [ROUND_COUNT=3] [ROCCHIO_OPTION]...
+
+TIMEFORMAT=' \[%3Rs at CPU usage of %P%% with user/sys ratio of `echo "scale=3; %3U/%3S;" | bc 2>/dev/null`\]'
+
+. ../roi_fixture.sh
+setup_roi_fixture "$1" tf
+
+round_count=${2:-3}
+shift
+if [ $# -gt 0 ]; then
+    shift
+fi
+rocchio_options=${@:--B 0 -I 1 -M 2 -E 1 -P 30 -S 1 -J 1}
+
+write_roi_documents tf tf doc_cat.txt || exit 1
+ls -d $PWD/tf/* > doc.txt
+
+for order in sorted frequency; do
+    option=
+    if [ $order == frequency ]; then
+	option=-f
+    fi
+    ($exec_dir/idf_dic $option -o idf_dic_$order.bin doc.txt \
+	&& $exec_dir/w_to_vector -D idf_dic_$order.bin -o w_$order.bin doc.txt) \
+	|| exit 1
+done
+
+# The jujitsu of eval and sed is needed to pretty print the timing
+# information while preserving any error message. I assume that there is no
+# shell metacharacters in the timing line that needs to be escaped by sed to
+# avoid more complicated jujitsu of sed
+not_timing_line='/\\\[.*at CPU usage.*\\\]$/!'
+    timing_line='/\\\[.*at CPU usage.*\\\]$/' # just throwing `!' away
+
+for ((i = 1; i <= $round_count; i++)); do
+    for order in sorted frequency; do
+	echo -n "rocchio on $order offsets: "
+	eval `(time $exec_dir/rocchio -D doc_cat.txt $rocchio_options \
+	    -o W_$order.bin w_$order.bin) \
+	    2>&1 \
+	    | sed \
+	    -e "$not_timing_line s%'%'\\\\''%g" \
+	    -e "$not_timing_line s%.*%echo '&';%" \
+	    -e "$timing_line"' s%.*%echo &%'` \
+	    | sed \
+	    -e 's% with user/sys ratio of ]% of infinity]%'
+    done
+done
+
+# The same W vectors classify the documents in the same way
+for order in sorted frequency; do
+    $exec_dir/classifier -D W_$order.bin -o classification_$order.txt \
+	w_$order.bin || exit 1
+done
+if cmp -s classification_sorted.txt classification_frequency.txt; then
+    echo "Both orders give the same classification"
+else
+    echo "The orders give different classifications" >&2
+    exit 1
+fi
+
+exit 0
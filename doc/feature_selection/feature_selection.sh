@@ -0,0 +1,72 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Usage: feature_selection.sh TEMP_DIR [FEATURE_COUNTS="all 10000 3000 1000 300"] [ROCCHIO_OPTION]...
+
+. ../roi_fixture.sh
+setup_roi_fixture "$1" tf
+
+feature_counts=${2:-all 10000 3000 1000 300}
+shift
+if [ $# -gt 0 ]; then
+    shift
+fi
+rocchio_options=${@:--B 0 -I 1 -M 2 -E 1 -P 30 -S 1 -J 1}
+
+write_roi_documents tf tf doc_cat.txt || exit 1
+
+# Every fourth document in the order of the names goes to the testing set
+ls tf | sort | awk '
+NR % 4 == 0 { print > "testing.txt"; next }
+{ print > "training.txt" }' || exit 1
+for set in training testing; do
+    sed "s%^%$PWD/tf/%" $set.txt > doc_$set.txt
+    awk 'FNR == NR { member[$1] = 1; next } $1 in member' \
+	$set.txt doc_cat.txt > doc_cat_$set.txt
+done
+
+echo -e "SCORE\tN\tuBEP (testing set)"
+for score in chi2 ig; do
+    for count in $feature_counts; do
+	if [ $count == all ]; then
+	    if [ $score != chi2 ]; then
+		continue
+	    fi
+	    option=
+	else
+	    option="-K $count -s $score -C doc_cat_training.txt"
+	fi
+	($exec_dir/idf_dic $option -o idf_dic.bin doc_training.txt \
+	    && $exec_dir/w_to_vector -D idf_dic.bin -o w_training.bin \
+	    doc_training.txt \
+	    && $exec_dir/w_to_vector -D idf_dic.bin -o w_testing.bin \
+	    doc_testing.txt \
+	    && $exec_dir/rocchio -D doc_cat_training.txt $rocchio_options \
+	    -o W.bin w_training.bin > /dev/null \
+	    && $exec_dir/classifier -D W.bin -o classification.txt \
+	    w_testing.bin \
+	    && $exec_dir/perf_measurer -D doc_cat_testing.txt \
+	    -o perf_measure_${score}_$count.txt classification.txt) \
+	    || exit 1
+	echo -e "$score\t$count\t`tail -n 1 perf_measure_${score}_$count.txt \
+	    | cut -f 6`"
+    done
+done
+
+exit 0
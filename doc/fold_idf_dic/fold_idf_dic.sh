@@ -0,0 +1,53 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Usage: fold_idf_dic.sh TEMP_DIR [FOLD_COUNT=4]
+
+. ../roi_fixture.sh
+setup_roi_fixture "$1" tf
+
+fold_count=${2:-4}
+
+write_roi_documents tf tf || exit 1
+ls tf | sort | sed "s%^%$PWD/tf/%" > doc.txt
+
+$exec_dir/idf_dic -v 2 -o idf_dic_corpus.bin doc.txt || exit 1
+$exec_dir/w_to_vector -t -D idf_dic_corpus.bin -o raw_w.bin doc.txt || exit 1
+
+TIMEFORMAT=%R
+echo -e "FOLD\tidf_dic on the rest\tidf_dic -B"
+for ((fold = 0; fold < fold_count; fold++)); do
+    awk -v k=$fold_count -v i=$fold '(NR - 1) % k == i' doc.txt > held_out.txt
+    awk -v k=$fold_count -v i=$fold '(NR - 1) % k != i' doc.txt > rest.txt
+    recount=`{ time $exec_dir/idf_dic -v 2 -o idf_dic_1.bin rest.txt ; } \
+	2>&1` || exit 1
+    derive=`{ time $exec_dir/idf_dic -B idf_dic_corpus.bin -T raw_w.bin \
+	-o idf_dic_2.bin held_out.txt ; } 2>&1` || exit 1
+    echo -e "$fold\t$recount\t$derive"
+
+    # Merging drops the words whose doc_count is zero in the fold
+    $exec_dir/idf_dic -m -A idf_dic_2.bin -v 2 -o idf_dic_3.bin || exit 1
+    if ! cmp -s idf_dic_1.bin idf_dic_3.bin; then
+	echo "The results of fold $fold differ" >&2
+	exit 1
+    fi
+done
+echo "The results are the same"
+
+exit 0
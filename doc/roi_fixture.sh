@@ -0,0 +1,76 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Sourced by the scripts in the subdirectories of doc, which are run from their
+# own directory, to set up a temporary directory holding documents of the ROI
+# corpus in ../ROI/TF.
+
+# Usage: setup_roi_fixture TEMP_DIR SUBDIR
+# Build the processing units into exec_dir, empty TEMP_DIR, make SUBDIR in it
+# and change into it. roi_tf_dir is set to the corpus directory.
+setup_roi_fixture() {
+    if [ "x$1" == x ] || [ "$1" == / ]; then
+	echo "Temporary directory must be specified" >&2
+	exit 1
+    fi
+    tmp_dir=$1
+
+    exec_dir=`cd ../.. && pwd`
+    roi_tf_dir=`cd ../ROI/TF && pwd`
+
+    (cd "$exec_dir" && make) > /dev/null || exit 1
+
+    rm -rf "$tmp_dir" && mkdir -p "$tmp_dir/$2" && cd "$tmp_dir" || exit 1
+}
+
+# Usage: write_roi_documents DOC_DIR tf|text [DOC_CAT_FILE]
+# Every line of ../ROI/TF/CAT.le is DOC_NAME\tWORD\tCOUNT. A document listed in
+# more than one category has the same words in each of them, so only those of
+# its first category are written into DOC_DIR/DOC_NAME, either as a TF file or
+# as text having every word as many times as it is counted. If DOC_CAT_FILE is
+# given, every DOC_NAME CAT pair is written into it.
+write_roi_documents() {
+    awk -F'\t' -v doc_dir="$1" -v format="$2" -v doc_cat="$3" '
+FNR == 1 { cat = FILENAME; sub(/.*\//, "", cat); sub(/\.le$/, "", cat) }
+{
+  if (doc_cat != "" && !(($1, cat) in member)) {
+    member[$1, cat] = 1
+    print $1 " " cat > doc_cat
+  }
+  if (!($1 in owner)) {
+    owner[$1] = cat
+  }
+  if (owner[$1] == cat) {
+    if ($1 != last) {
+      if (last != "") {
+        close(doc_dir "/" last)
+      }
+      last = $1
+    }
+    if (format == "text") {
+      for (i = 0; i < $3; i++) {
+        printf "%s ", $2 >> (doc_dir "/" $1)
+      }
+      print "" >> (doc_dir "/" $1)
+    } else {
+      print $2 " " $3 >> (doc_dir "/" $1)
+    }
+  }
+}' "$roi_tf_dir"/*.le
+}
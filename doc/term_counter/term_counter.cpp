@@ -0,0 +1,181 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <ctime>
+#include "../../utility.h"
+#include "../../utility_term_counter.hpp"
+
+using namespace std;
+
+/* The token stream of one document is replayed from its TF by emitting every
+ * term of the document once per round until all counts are used up.
+ */
+typedef vector<string> class_doc_terms;
+typedef vector<unsigned int> class_doc_counts;
+typedef pair<class_doc_terms, class_doc_counts> class_doc;
+static vector<class_doc> docs;
+static string last_doc_name;
+static string line;
+static unsigned int round_count = 10;
+static char *buffer = NULL;
+CLEANUP_BEGIN
+{
+  if (buffer != NULL) {
+    free(buffer);
+  }
+} CLEANUP_END
+
+static inline void partial_fn(char *str)
+{
+  line.append(str);
+}
+
+/* Each line is DOC_NAME\tTERM\tCOUNT */
+static inline void complete_fn(void)
+{
+  size_t tab1 = line.find('\t');
+  size_t tab2 = line.find('\t', tab1 + 1);
+
+  if (tab1 == line.npos || tab2 == line.npos) {
+    fatal_error("`%s' is a malformed TF line", line.c_str());
+  }
+
+  if (docs.empty() || line.compare(0, tab1, last_doc_name) != 0) {
+    last_doc_name.assign(line, 0, tab1);
+    docs.push_back(class_doc());
+  }
+
+  docs.back().first.push_back(line.substr(tab1 + 1, tab2 - tab1 - 1));
+  docs.back().second.push_back(strtoul(line.c_str() + tab2 + 1, NULL, 10));
+
+  line.clear();
+}
+
+static inline void replay(const class_doc &doc, vector<const char *> &tokens,
+			  vector<size_t> &lengths)
+{
+  class_doc_counts left(doc.second);
+  bool more = true;
+
+  tokens.clear();
+  lengths.clear();
+  while (more) {
+    more = false;
+    for (size_t i = 0; i < left.size(); i++) {
+      if (left[i] > 0) {
+	tokens.push_back(doc.first[i].c_str());
+	lengths.push_back(doc.first[i].length());
+	left[i]--;
+	more = true;
+      }
+    }
+  }
+}
+
+static inline double now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+MAIN_BEGIN(
+"term_counter",
+"Each input file is a TF file of doc/ROI/TF whose lines take the form\n"
+"DOC_NAME\\tTERM\\tCOUNT\\n.\n"
+"The token stream of every document is rebuilt from the TF and counted\n"
+"using unordered_map<string, int> as tf used to do and using\n"
+"class_term_counter. Both are repeated the number of rounds given by the\n"
+"option -R, which defaults to 10.\n",
+"R:",
+"[-R ROUND_COUNT]",
+1,
+case 'R':
+round_count = strtoul(optarg, NULL, 10);
+break;
+
+NO_MORE_CASE
+) {
+  /* Allocating tokenizing buffer */
+  buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+  if (buffer == NULL) {
+    fatal_error("Insufficient memory");
+  }
+  /* End of allocation */
+}
+MAIN_INPUT_START
+{
+  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn, complete_fn);
+}
+MAIN_INPUT_END
+{
+  vector<vector<const char *> > tokens(docs.size());
+  vector<vector<size_t> > lengths(docs.size());
+  size_t token_count = 0;
+
+  for (size_t i = 0; i < docs.size(); i++) {
+    replay(docs[i], tokens[i], lengths[i]);
+    token_count += tokens[i].size();
+  }
+
+  unsigned long checksum_map = 0;
+  double start = now();
+  for (unsigned int r = 0; r < round_count; r++) {
+    for (size_t i = 0; i < docs.size(); i++) {
+      unordered_map<string, int> feature_list;
+      string word;
+      for (size_t j = 0; j < tokens[i].size(); j++) {
+	word.append(tokens[i][j], lengths[i][j]);
+	feature_list[word] += 1;
+	word.clear();
+      }
+      checksum_map += feature_list.size();
+    }
+  }
+  double map_time = now() - start;
+
+  unsigned long checksum_counter = 0;
+  class_term_counter counter;
+  start = now();
+  for (unsigned int r = 0; r < round_count; r++) {
+    for (size_t i = 0; i < docs.size(); i++) {
+      for (size_t j = 0; j < tokens[i].size(); j++) {
+	counter.add(tokens[i][j], lengths[i][j]);
+      }
+      checksum_counter += counter.size();
+      counter.reset();
+    }
+  }
+  double counter_time = now() - start;
+
+  if (checksum_map != checksum_counter) {
+    fatal_error("The counters disagree (%lu vs %lu)",
+		checksum_map, checksum_counter);
+  }
+
+  fprintf(out_stream, "%lu documents, %lu tokens, %u rounds\n",
+	  static_cast<unsigned long>(docs.size()),
+	  static_cast<unsigned long>(token_count), round_count);
+  fprintf(out_stream, "unordered_map<string, int>: %.3fs (%.1f ns/token)\n",
+	  map_time, map_time * 1e9 / (token_count * round_count));
+  fprintf(out_stream, "class_term_counter: %.3fs (%.1f ns/token)\n",
+	  counter_time, counter_time * 1e9 / (token_count * round_count));
+}
+MAIN_END
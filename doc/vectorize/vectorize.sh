@@ -0,0 +1,48 @@
+#!/bin/bash
+
+#############################################################################
+# Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  #
+#                                                                           #
+# This program is free software: you can redistribute it and/or modify      #
+# it under the terms of the GNU General Public License as published by      #
+# the Free Software Foundation, either version 3 of the License, or         #
+# (at your option) any later version.                                       #
+#                                                                           #
+# This program is distributed in the hope that it will be useful,           #
+# but WITHOUT ANY WARRANTY; without even the implied warranty of            #
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             #
+# GNU General Public License for more details.                              #
+#                                                                           #
+# You should have received a copy of the GNU General Public License         #
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.     #
+#############################################################################
+
+# Usage: vectorize.sh TEMP_DIR [ROUND_COUNT=5]
+
+. ../roi_fixture.sh
+setup_roi_fixture "$1" tf
+
+round_count=${2:-5}
+
+write_roi_documents tf tf || exit 1
+ls tf | sort | sed "s%^%$PWD/tf/%" > doc.txt
+
+TIMEFORMAT=%R
+echo -e "ROUND\tidf_dic + w_to_vector\tvectorize"
+for ((round = 1; round <= round_count; round++)); do
+    two_units=`{ time ($exec_dir/idf_dic -v 2 -o idf_dic_1.bin doc.txt \
+	&& $exec_dir/w_to_vector -D idf_dic_1.bin -o w_1.bin doc.txt) ; } \
+	2>&1` || exit 1
+    one_unit=`{ time $exec_dir/vectorize -D idf_dic_2.bin -o w_2.bin \
+	doc.txt ; } 2>&1` || exit 1
+    echo -e "$round\t$two_units\t$one_unit"
+done
+
+if cmp -s idf_dic_1.bin idf_dic_2.bin && cmp -s w_1.bin w_2.bin; then
+    echo "The results are the same"
+else
+    echo "The results differ" >&2
+    exit 1
+fi
+
+exit 0
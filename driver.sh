@@ -30,6 +30,7 @@ prog_name=driver.sh
 testing_from_step=6
 file_w_vectors_name=training_set_w_vectors.bin
 file_w_vectors_testing_name=testing_set_w_vectors.bin
+file_tf_container_name=tf_container.bin
 
 # Default values
 from_step=0
@@ -49,16 +50,29 @@ custom_ES=
 validation_testset_percentage=
 skip_step_6=0
 crossval_rseed=1
+unit_thread_count=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`
+use_container=0
+use_dedup=0
+selected_feature_count=
+min_df=
+feature_score=chi2
+feature_hashing_bits=
+signed_hashing=0
+raw_w_vectors_dir=
 # End of default values
 
-while getopts hX:t:s:r:x:a:b:B:I:M:E:P:S:H:F:f:lJ:T:V:DR: option; do
+while getopts hX:t:s:r:x:p:n:k:G:Ya:b:B:I:M:E:P:S:H:F:f:lJ:j:cUT:V:DR:w: option; do
     case $option in
 	X) excluded_cat=$OPTARG;;
 	t) training_dir=$OPTARG;;
 	s) testing_dir=$OPTARG;;
 	r) tmp_dir=$OPTARG;;
 	x) exec_dir=$OPTARG;;
-	p) f_selection_rate=$OPTARG;;
+	p) selected_feature_count=$OPTARG;;
+	n) min_df=$OPTARG;;
+	k) feature_score=$OPTARG;;
+	G) feature_hashing_bits=$OPTARG;;
+	Y) signed_hashing=1;;
 	a) from_step=$OPTARG;;
 	b) to_step=$OPTARG;;
 	B) p_init=$OPTARG;;
@@ -72,10 +86,14 @@ while getopts hX:t:s:r:x:a:b:B:I:M:E:P:S:H:F:f:lJ:T:V:DR: option; do
 	l) use_stop_list=1;;
 	f) file_stop_list=$OPTARG;;
 	J) tuner_count=$OPTARG;;
+	j) unit_thread_count=$OPTARG;;
+	c) use_container=1;;
+	U) use_dedup=1;;
 	T) custom_ES=$OPTARG;;
 	V) validation_testset_percentage=$OPTARG;;
 	D) skip_step_6=1;;
 	R) crossval_rseed=$OPTARG;;
+	w) raw_w_vectors_dir=$OPTARG;;
 	h|?) cat >&2 <<EOF
 Usage: $prog_name
        -B [INITIAL_VALUE_OF_P=$p_init]
@@ -94,10 +112,19 @@ Usage: $prog_name
        -l [ENABLE_STOP_LIST=no]
        -f [STOP_LIST_FILE=EXEC_DIR/english.stop]
        -J [PARAMETER_TUNING_THREAD_COUNT=1]
+       -j [PROCESSING_UNIT_THREAD_COUNT=$unit_thread_count]
+       -c [STORE_TF_IN_ONE_CONTAINER_FILE=no]
+       -U [COUNT_IDENTICAL_DOCUMENTS_ONCE=no]
        -T [CUSTOM_ES=]
        -V [VALIDATION_TESTING_SET_PERCENTAGE=]
        -D [SKIP_STEP_6=no]
        -R [RANDOM_SEED_FOR_CROSS_VALIDATION_SPLIT=$crossval_rseed]
+       -p [SELECTED_FEATURE_COUNT=all]
+       -n [MINIMUM_DOC_FREQUENCY_OF_A_FEATURE=1]
+       -k [FEATURE_SCORE=$feature_score (chi2 or ig)]
+       -G [FEATURE_HASHING_BITS=]
+       -Y [ENABLE_SIGNED_FEATURE_HASHING=no]
+       -w [RAW_W_VECTORS_DIR=]
        -a [EXECUTE_FROM_STEP_A=$from_step]
        -b [EXECUTE_TO_STEP_B=$to_step]
 
@@ -107,6 +134,16 @@ The name of excluded category must not contain any shell special character or
 
 For an arbitrary selection of random seed, specify -1 to -S or -R.
 
+To store the TF of all documents of a set in the single file $file_tf_container_name instead of one file per document, specify -c. The option cannot be used together with -V.
+
+To tokenize and count the documents having the same bytes under different names only once in Step 1, specify -U. The TF files are the same.
+
+To prune the features in Step 3, specify -n to drop the words occurring in fewer training documents than the argument, or -p to keep only as many words as the argument having the highest scores against the training DOC_CAT file, or both. The score given to -k is either chi2 for the maximum chi-square statistic over the categories or ig for the information gain. When -p is specified, Step 3 is not multithreaded.
+
+To use feature hashing instead of a dictionary, specify -G with the number of bits of a hashed offset, which is at most 30. Step 3 then counts the document frequencies per hashed offset, and the words of the testing set that are not in the training set are hashed as well. The option cannot be used together with -p or -n. To negate the weight of half of the words so that collisions tend to cancel out, specify -Y as well.
+
+To vectorize the documents of both sets only once, specify -w with a directory, which may be shared by many runs on the same TF files. If the directory does not exist yet, Step 3 creates it and puts there the IDF_DIC and the raw w vectors (see w_to_vector -t) of all documents of both sets, which are also the TF files of Step $testing_from_step that Step 2 then builds first unless -D is specified. Then, Step 3 derives the IDF_DIC of the training set from those of the directory (see idf_dic -B), Step 4 and Step $((testing_from_step + 2)) pick the raw w vectors of the training and testing sets from the directory instead of vectorizing the documents, and the processing units of Step 5 and later steps weight the raw w vectors by the IDF_DIC of the training set as they are loaded. So, a custom ES given to -T must hold raw w vectors as well. A document name must not be in both sets, and the option cannot be used together with -c, -p or -n.
+
 To build training and testing sets according to cross validation technique, specify -V, give the percentage of documents that should go to the testing set as the argument, and run Step 2. The percentage is a real number between 0 and 100, inclusive. This option works by replacing both Step 2 and Step $((testing_from_step + 1)) with a single step that builds DOC and DOC_CAT files for both training and testing phases following cross validation approach. Step $((testing_from_step + 1)) will automatically be run unless -D is specified.
 
 Available steps:
@@ -181,6 +218,20 @@ if [ \! -d $exec_dir ]; then
     echo "Directory containing executables does not exist" >&2
     exit 1
 fi
+if [ $use_container -eq 1 -a -n "$validation_testset_percentage" ]; then
+    echo "-c cannot be used together with -V" >&2
+    exit 1
+fi
+if [ -n "$raw_w_vectors_dir" ]; then
+    if [ $use_container -eq 1 ]; then
+	echo "-w cannot be used together with -c" >&2
+	exit 1
+    fi
+    if [ -n "$selected_feature_count" -o -n "$min_df" ]; then
+	echo "-w cannot be used together with -p or -n" >&2
+	exit 1
+    fi
+fi
 
 # Executable files
 tokenizer=$exec_dir/tokenizer
@@ -188,13 +239,6 @@ if [ \! -x $tokenizer ]; then
     echo "tokenizer does not exist or is not executable" >&2
     exit 1
 fi
-if [ $use_stop_list -eq 1 ]; then
-    stop_list=$exec_dir/stop_list
-    if [ ! -x $stop_list ]; then
-	echo "stop list does not exist or is not executable" >&2
-	exit 1
-    fi
-fi
 tf=$exec_dir/tf
 if [ \! -x $tf ]; then
     echo "tf does not exist or is not executable" >&2
@@ -230,6 +274,11 @@ if [ \! -x $perf_measurer ]; then
     echo "crossval_splitter does not exist or is not executable" >&2
     exit 1
 fi
+mod_vec=$exec_dir/mod_vec
+if [ \! -x $mod_vec ]; then
+    echo "mod_vec does not exist or is not executable" >&2
+    exit 1
+fi
 # End of executable files
 
 tmp_training_dir=$tmp_dir/training
@@ -267,12 +316,25 @@ file_perf_measure=$tmp_dir/perf_measure.txt
 file_doc_cat_crossval_all=$tmp_dir/crossval_all_doc_cat.txt
 # End of cross validation setup
 
+# Files of the documents of both sets shared through -w
+file_doc_corpus=$raw_w_vectors_dir/doc.txt
+file_idf_dic_corpus=$raw_w_vectors_dir/idf_dic.bin
+file_raw_w_vectors_corpus=$raw_w_vectors_dir/raw_w_vectors.bin
+file_doc_held_out=$tmp_dir/held_out_doc.txt
+# End of files of the documents of both sets
+
 # Intermediate files of the extra steps
 file_classification_training=$tmp_dir/classification_on_training_set.txt
 file_perf_measure_training=$tmp_dir/perf_measure_on_training_set.txt
 file_doc_cat_perf_measure_training=$tmp_dir/training_set_perf_measure_doc_cat.txt
 # End of intermediate files of the extra steps
 
+if [ -n "$raw_w_vectors_dir" ]; then
+    idf_weighting="-W $file_idf_dic"
+else
+    idf_weighting=
+fi
+
 # Start of common functions
 
 # $1 is the corpus training/testing directory
@@ -295,27 +357,30 @@ function create_dir_struct {
 function tokenization_and_tf_calculation {
     repo_dir=$1/repo
 
+    # One process tokenizes and counts all documents using a fixed number of
+    # threads instead of one tokenizer | grep | tf pipeline per document. The
+    # stop words are dropped by tf while tokenizing instead of having the
+    # tokenizer and stop_list rewrite each document.
     if [ $use_stop_list -eq 1 ]; then
+	stop_list_option="-D $file_stop_list"
+    else
+	stop_list_option=
+    fi
 
-	# As stated in the BASH manual, the use of a pipe will make the shell
-	# waits for all children to complete.
-
-	# 40.731s at CPU usage of 100.00% with user/sys ratio of .541
-	# Try to just use a simple pipe? Or, avoid the mv first?
-	(for file in `ls $repo_dir`; do
- 	    ($tokenizer -o $repo_dir/$file.tok $repo_dir/$file
-	     mv $repo_dir/$file{.tok,}
-	     echo $repo_dir/$file) &
-	 done | $stop_list -D $file_stop_list) \
-	| xargs -P 0 -I'{}' $tf -o $1/'{}' $repo_dir/'{}'
+    if [ $use_dedup -eq 1 ]; then
+	dedup_option=-u
     else
-	for file in `ls $repo_dir`; do
-	    ($tokenizer $repo_dir/$file \
-		| grep -v '^[0-9a-z]$' | $tf -o $1/$file) &
-	done
+	dedup_option=
     fi
 
-    wait
+    if [ $use_container -eq 1 ]; then
+	find $repo_dir/ -maxdepth 1 -type f ! -name '.*' \
+	    | $tf -b $stop_list_option $dedup_option -J $unit_thread_count \
+	    -C $1/$file_tf_container_name
+    else
+	find $repo_dir/ -maxdepth 1 -type f ! -name '.*' \
+	    | $tf -b $stop_list_option $dedup_option -J $unit_thread_count -O $1
+    fi
 }
 
 function get_doc_cat {
@@ -330,7 +395,7 @@ function get_doc_cat {
 # $4 is the resulting DOC_CAT file containing docs across all cats other than
 #       the excluded cat
 function DOC_and_DOC_CAT_files_generation {
-    find $2/ -maxdepth 1 -type f > $3
+    find $2/ -maxdepth 1 -type f ! -name '.*' > $3
     find $1/ -mindepth 2 -type f -printf '%P\n' | get_doc_cat \
 	| grep -v $excluded_cat\$ > $4
 }
@@ -344,7 +409,43 @@ function perf_measure_DOC_CAT_files_generation {
 # $1 is the DOC file
 # $2 is the resulting w vectors file
 function w_vectors_generation {
-    $w_to_vector -D $file_idf_dic -o $2 $1
+    if [ -n "$raw_w_vectors_dir" ]; then
+	$mod_vec -D <(sed -e 's%.*/%%' $1) -v -o $2 $file_raw_w_vectors_corpus
+	return
+    fi
+
+    local hashing=
+    if [ $signed_hashing -eq 1 ]; then
+	hashing=-g
+    fi
+    $w_to_vector -J $unit_thread_count -D $file_idf_dic $hashing -o $2 $1
+}
+
+# Builds the IDF_DIC and the raw w vectors of the documents of both sets
+function raw_w_vectors_generation {
+    mkdir -p $raw_w_vectors_dir || return 1
+
+    find $tmp_training_dir/ $tmp_testing_dir/ -maxdepth 1 -type f ! -name '.*' \
+	> $file_doc_corpus
+    if [ -n "`sed -e 's%.*/%%' $file_doc_corpus | sort | uniq -d`" ]; then
+	echo "A document name is in both the training and testing sets" >&2
+	rm -r $raw_w_vectors_dir
+	return 1
+    fi
+
+    local dic_options=
+    local hashing=
+    if [ -n "$feature_hashing_bits" ]; then
+	dic_options="-H $feature_hashing_bits"
+    fi
+    if [ $signed_hashing -eq 1 ]; then
+	hashing=-g
+    fi
+    $idf_dic -J $unit_thread_count -v 2 $dic_options -o $file_idf_dic_corpus \
+	$file_doc_corpus \
+	&& $w_to_vector -J $unit_thread_count -t -D $file_idf_dic_corpus \
+	$hashing -o $file_raw_w_vectors_corpus $file_doc_corpus \
+	|| { rm -r $raw_w_vectors_dir; return 1; }
 }
 
 # End of common functions
@@ -365,6 +466,9 @@ function step_1 {
 }
 
 function step_2 {
+    if [ -n "$raw_w_vectors_dir" -a -z "$validation_testset_percentage" ]; then
+	step_6
+    fi
     if [ -n "$validation_testset_percentage" ]; then
 	step_6
 	echo -n "2. [CROSS VALIDATION SETUP] Generating files... [rseed=$crossval_rseed]"
@@ -415,8 +519,36 @@ function step_2 {
 }
 
 function step_3 {
+    if [ -n "$raw_w_vectors_dir" ]; then
+	echo -n "3. [TRAINING] IDF calculation and DIC building [raw_w_vectors]..."
+	time (
+	    if [ ! -d $raw_w_vectors_dir ]; then
+		raw_w_vectors_generation || exit 1
+	    fi
+	    awk -F / 'NR == FNR { training[$NF]; next } !($NF in training)' \
+		$file_doc_training $file_doc_corpus > $file_doc_held_out \
+		&& $idf_dic -B $file_idf_dic_corpus \
+		-T $file_raw_w_vectors_corpus -v 2 -o $file_idf_dic \
+		$file_doc_held_out
+	) \
+	    || exit 1
+	return
+    fi
+
     echo -n "3. [TRAINING] IDF calculation and DIC building..."
-    time ($idf_dic -o $file_idf_dic $file_doc_training) \
+    local dic_options=
+    if [ -n "$min_df" ]; then
+	dic_options="-n $min_df"
+    fi
+    if [ -n "$feature_hashing_bits" ]; then
+	dic_options="$dic_options -H $feature_hashing_bits"
+    fi
+    if [ -n "$selected_feature_count" ]; then
+	dic_options="$dic_options -K $selected_feature_count -s $feature_score"
+	dic_options="$dic_options -C $file_doc_cat_training"
+    fi
+    time ($idf_dic -J $unit_thread_count -v 2 $dic_options -o $file_idf_dic \
+	$file_doc_training) \
 	|| exit 1
 }
 
@@ -432,21 +564,22 @@ function step_5 {
 	    echo -n "5. [TRAINING] PRCs generation [custom_ES=no,BEP_h_script=no,seed=$ES_rseed]..."
 	    time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		-M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		-o $file_W_vectors -J $tuner_count $file_w_vectors_training) \
+		$idf_weighting -o $file_W_vectors -J $tuner_count \
+		$file_w_vectors_training) \
 		|| exit 1
 	else
 	    if [ -z "$BEP_history_filter" ]; then
 		echo -n "5. [TRAINING] PRCs generation [custom_ES=no,BEP_h_script=yes-nofilter,seed=$ES_rseed]..."
 		time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		    -M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		    -o $file_W_vectors -H $BEP_history_script \
+		    $idf_weighting -o $file_W_vectors -H $BEP_history_script \
 		    -J $tuner_count $file_w_vectors_training) \
 		    || exit 1
 	    else
 		echo -n "5. [TRAINING] PRCs generation [custom_ES=no,BEP_h_script=yes-filtered,seed=$ES_rseed]..."
 		time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		    -M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		    -o $file_W_vectors -H $BEP_history_script \
+		    $idf_weighting -o $file_W_vectors -H $BEP_history_script \
 		    -F $BEP_history_filter -J $tuner_count \
 		    $file_w_vectors_training) \
 		    || exit 1
@@ -457,22 +590,22 @@ function step_5 {
 	    echo -n "5. [TRAINING] PRCs generation [custom_ES=yes,BEP_h_script=no,seed=$ES_rseed]..."
 	    time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		-M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		-o $file_W_vectors -J $tuner_count -T $custom_ES \
-		$file_w_vectors_training) \
+		$idf_weighting -o $file_W_vectors -J $tuner_count \
+		-T $custom_ES $file_w_vectors_training) \
 		|| exit 1
 	else
 	    if [ -z "$BEP_history_filter" ]; then
 		echo -n "5. [TRAINING] PRCs generation [custom_ES=yes,BEP_h_script=yes-nofilter,seed=$ES_rseed]..."
 		time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		    -M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		    -o $file_W_vectors -H $BEP_history_script \
+		    $idf_weighting -o $file_W_vectors -H $BEP_history_script \
 		    -J $tuner_count -T $custom_ES $file_w_vectors_training) \
 		    || exit 1
 	    else
 		echo -n "5. [TRAINING] PRCs generation [custom_ES=yes,BEP_h_script=yes-filtered,seed=$ES_rseed]..."
 		time ($rocchio -D $file_doc_cat_training -B $p_init -I $p_inc \
 		    -M $p_max -E $ES_count -P $ES_percentage -S $ES_rseed \
-		    -o $file_W_vectors -H $BEP_history_script \
+		    $idf_weighting -o $file_W_vectors -H $BEP_history_script \
 		    -F $BEP_history_filter -J $tuner_count -T $custom_ES \
 		    $file_w_vectors_training) \
 		    || exit 1
@@ -510,8 +643,8 @@ function step_8 {
 
 function step_9 {
     echo -n "9. [TESTING] OVA classification of test set..."
-    time ($classifier -D $file_W_vectors -o $file_classification \
-	$file_w_vectors_testing) \
+    time ($classifier -D $file_W_vectors $idf_weighting \
+	-o $file_classification $file_w_vectors_testing) \
 	|| exit 1
 }
 
@@ -524,7 +657,8 @@ function step_10 {
 
 function step_11 {
     echo -n "11. [EXTRA STEP] OVA classification of training set..."
-    time ($classifier -D $file_W_vectors -o $file_classification_training \
+    time ($classifier -D $file_W_vectors $idf_weighting \
+	-o $file_classification_training \
 	$file_w_vectors_training) \
 	|| exit 1
 }
@@ -548,6 +682,9 @@ for ((i = $from_step; i <= $to_step; i++)); do
     if [ -n "$validation_testset_percentage" -a $i -eq 6 ]; then
 	continue
     fi
+    if [ -n "$raw_w_vectors_dir" -a $i -eq 6 ]; then
+	continue
+    fi
 
     eval `step_$i \
 	2>&1 \
@@ -15,49 +15,798 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *****************************************************************************/
 
+#define THREADED
+
+#include <vector>
 #include <list>
-#include <string>
+#include <algorithm>
 #include <unordered_map>
+#include <unordered_set>
+#include <string>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <cmath>
 #include "utility.h"
 #include "utility.hpp"
+#include "utility_span.hpp"
+#include "utility_tf.hpp"
+#include "utility_container.hpp"
+#include "utility_term_counter.hpp"
+#include "utility_thread.hpp"
+#include "utility_vector.hpp"
+#include "utility_idf_dic.hpp"
+#include "utility_doc_cat_list.hpp"
+#include "utility_df_sketch.hpp"
+#include "utility_prefetch.hpp"
 
 using namespace std;
 
+/* What one worker needs to count the document frequencies of its share of the
+ * TF files in the threaded mode. The words are counted in one table per shard
+ * (see struct df_shard) so that a shard merges only its own words.
+ */
+struct df_worker {
+  char *buffer;
+  struct input_context ctx;
+  vector<class_term_counter> dfs;
+  unsigned long doc_count;
+};
+
+/* A container given in place of the list of TF files is mapped whole so that
+ * its records can be spread among the workers
+ */
+struct mapped_container {
+  struct input_context ctx;
+  void *map;
+  size_t map_length;
+  class_container_reader reader;
+};
+
 static char *buffer = NULL;
+static struct df_worker *workers = NULL;
+static unsigned int worker_count = 1;
+static list<struct mapped_container> containers;
 CLEANUP_BEGIN
 {
   if (buffer != NULL) {
     free(buffer);
   }
+  if (workers != NULL) {
+    for (unsigned int i = 0; i < worker_count; i++) {
+      free(workers[i].buffer);
+      destroy_input_context(&workers[i].ctx);
+    }
+    delete [] workers;
+  }
+  for (list<struct mapped_container>::iterator i = containers.begin();
+       i != containers.end(); ++i) {
+    release_in_stream(&i->ctx, i->map, i->map_length);
+    destroy_input_context(&i->ctx);
+  }
 } CLEANUP_END
 
-typedef unordered_map<string, unsigned int> class_idf_list;
+typedef unordered_map<class_span, unsigned int, span_hash> class_idf_list;
 static class_idf_list idf_list;
-static string word;
-typedef list<string> class_word_sorter;
+static class_string_pool words;
+typedef vector<class_span> class_word_sorter;
 static class_word_sorter word_sorter;
 
-static inline void partial_fn(char *f)
+/* @return the interned word */
+static inline const class_span &add_df(const char *f, size_t length,
+				       unsigned int count)
+{
+  class_span word(f, length);
+  class_idf_list::iterator i = idf_list.find(word);
+
+  if (i == idf_list.end()) {
+    word = words.intern(word);
+    i = idf_list.insert(make_pair(word, count)).first;
+    word_sorter.push_back(word);
+  } else {
+    i->second += count;
+  }
+
+  return i->first;
+}
+
+/* A word whose count drops to zero stays in the list but is not output */
+static inline void remove_df(const char *f, size_t length, unsigned int count,
+			     const char *path)
+{
+  class_idf_list::iterator i = idf_list.find(class_span(f, length));
+
+  if (i == idf_list.end() || i->second < count) {
+    fatal_error("%s removes %.*s from more documents than there are", path,
+		static_cast<int>(length), f);
+  }
+  i->second -= count;
+}
+
+/* When the option -C is given, the document frequency of every word is also
+ * counted per category of the DOC_CAT file to score the word
+ */
+static vector<string> cat_names;
+static unordered_map<string, unsigned int> cat_indices;
+typedef unordered_map<string, vector<unsigned int> > class_doc_cats;
+static class_doc_cats doc_cats;
+static vector<unsigned int> cat_doc_counts;
+typedef unordered_map<class_span, vector<unsigned int>, span_hash>
+class_cat_df_list;
+static class_cat_df_list cat_df_list;
+static const vector<unsigned int> *current_doc_cats = NULL;
+static const char *doc_cat_path = NULL;
+
+static inline void doc_cat_fn(const string &doc_name, const string &cat_name,
+			      void *arg)
+{
+  if (doc_name.empty()) {
+    fatal_error("DOC_CAT file must not contain an empty document name");
+  }
+  if (cat_name.empty()) {
+    fatal_error("DOC_CAT file must not contain an empty category name");
+  }
+
+  unordered_map<string, unsigned int>::iterator i = cat_indices.find(cat_name);
+  if (i == cat_indices.end()) {
+    i = cat_indices.insert(make_pair(cat_name, cat_names.size())).first;
+    cat_names.push_back(cat_name);
+  }
+
+  vector<unsigned int> &cats = doc_cats[doc_name];
+  if (find(cats.begin(), cats.end(), i->second) == cats.end()) {
+    cats.push_back(i->second);
+  }
+}
+
+static inline void load_doc_cats(const char *path)
+{
+  struct input_context ctx;
+
+  init_input_context(&ctx, NULL, NULL, buffer, BUFFER_SIZE);
+  open_input_context(&ctx, path);
+  load_doc_cat_file_r(&ctx, doc_cat_fn, NULL);
+  close_input_context(&ctx);
+  destroy_input_context(&ctx);
+
+  cat_doc_counts.assign(cat_names.size(), 0);
+}
+
+/* A document not in the DOC_CAT file has no category */
+static inline void begin_doc(const char *doc_name)
+{
+  if (doc_cat_path == NULL) {
+    return;
+  }
+
+  class_doc_cats::const_iterator i = doc_cats.find(doc_name);
+  if (i == doc_cats.end()) {
+    current_doc_cats = NULL;
+    return;
+  }
+
+  current_doc_cats = &i->second;
+  for (unsigned int j = 0; j < current_doc_cats->size(); j++) {
+    cat_doc_counts[(*current_doc_cats)[j]]++;
+  }
+}
+
+/* When the option -S is given, the document frequencies are only estimated */
+static size_t sketch_memory = 0;
+static class_df_sketch df_sketch;
+
+/* When the option -H is given, the document frequencies are counted per
+ * hashed offset. A document is counted once per offset however many of its
+ * words are hashed to the offset, for which the offset remembers the last
+ * document counted.
+ */
+static struct idf_dic_feature_hashing hashing = {0, 0};
+static vector<uint32_t> hashed_doc_counts;
+static vector<uint32_t> hashed_last_docs;
+
+static unsigned long M = 0;
+
+static inline void tf_fn(const char *f, size_t length, double count)
+{
+  if (sketch_memory != 0) {
+    df_sketch.add(f, length);
+    return;
+  }
+
+  if (hashing.bits != 0) {
+    unsigned int offset
+      = feature_hash_offset(feature_hash_value(hashing.seed, f, length),
+			    hashing.bits);
+    uint32_t doc = static_cast<uint32_t>(M + 1);
+
+    if (hashed_last_docs[offset] != doc) {
+      hashed_last_docs[offset] = doc;
+      hashed_doc_counts[offset]++;
+    }
+    return;
+  }
+
+  const class_span &word = add_df(f, length, 1);
+
+  if (current_doc_cats != NULL) {
+    vector<unsigned int> &cat_df = cat_df_list[word];
+    if (cat_df.empty()) {
+      cat_df.resize(cat_names.size(), 0);
+    }
+    for (unsigned int i = 0; i < current_doc_cats->size(); i++) {
+      cat_df[(*current_doc_cats)[i]]++;
+    }
+  }
+}
+
+static inline void record_fn(const char *doc_name, const char *tf,
+			     size_t length)
+{
+  begin_doc(doc_name);
+  parse_tf_data(tf, length, doc_name, 0, tf_fn);
+  M++;
+}
+
+/* Either a TF file or a record of a container */
+struct df_job {
+  const char *path;
+  const class_container_reader *container;
+  size_t record;
+};
+static vector<struct df_job> jobs;
+
+/* The vocabulary is split by the hash of a word mixed again so that the shard
+ * of a word does not follow the bits of the hash that the table of a shard
+ * uses to find its slot
+ */
+struct df_shard {
+  class_term_counter df;
+  vector<pair<class_span, unsigned int> > sorted;
+};
+static vector<struct df_shard> shards;
+
+static inline unsigned int shard_of(size_t hash)
+{
+  uint64_t h = hash;
+
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+
+  return h % shards.size();
+}
+
+static void df_tf_fn(const char *f, size_t length, double count, void *arg)
+{
+  struct df_worker *w = static_cast<struct df_worker *>(arg);
+  size_t hash = span_hash_value(f, length);
+
+  w->dfs[shard_of(hash)].add(f, length, hash, 1);
+}
+
+static void df_record_fn(const char *doc_name, const char *tf, size_t length,
+			 void *arg)
+{
+  parse_tf_data_r(tf, length, doc_name, 0, df_tf_fn, arg);
+  static_cast<struct df_worker *>(arg)->doc_count++;
+}
+
+/* A file in the list is found to be a container only once it is opened by
+ * the worker counting it, which then counts all of its records
+ */
+static void count_df(size_t job, unsigned int worker, void *arg)
+{
+  struct df_worker *w = &workers[worker];
+  const struct df_job &j = jobs[job];
+
+  if (j.container == NULL) {
+    open_input_context(&w->ctx, j.path);
+    if (!parse_container_r(&w->ctx, df_record_fn, w)) {
+      parse_tf_r(&w->ctx, 0, df_tf_fn, w);
+      w->doc_count++;
+    }
+    close_input_context(&w->ctx);
+  } else {
+    const char *doc_name;
+    const char *tf;
+    size_t length;
+
+    j.container->get(j.record, &doc_name, &tf, &length);
+    df_record_fn(doc_name, tf, length, w);
+  }
+}
+
+static void merge_shard(size_t shard, unsigned int worker, void *arg)
+{
+  struct df_shard &sh = shards[shard];
+
+  for (unsigned int i = 0; i < worker_count; i++) {
+    const class_term_counter &df = workers[i].dfs[shard];
+
+    for (size_t j = 0; j < df.size(); j++) {
+      const class_term_counter::term &t = df.get(j);
+      sh.df.add(df.name(t), t.length, t.hash, t.count);
+    }
+  }
+
+  sh.sorted.reserve(sh.df.size());
+  for (size_t j = 0; j < sh.df.size(); j++) {
+    const class_term_counter::term &t = sh.df.get(j);
+    sh.sorted.push_back(make_pair(class_span(sh.df.name(t), t.length),
+				  t.count));
+  }
+  sort(sh.sorted.begin(), sh.sorted.end());
+}
+
+/* Take the counts of the shards as if counted serially, which is needed only
+ * when DF states are to be merged in
+ */
+static inline void fold_shards(void)
+{
+  for (unsigned int i = 0; i < shards.size(); i++) {
+    const vector<pair<class_span, unsigned int> > &sorted = shards[i].sorted;
+
+    for (size_t j = 0; j < sorted.size(); j++) {
+      add_df(sorted[j].first.data, sorted[j].first.length, sorted[j].second);
+    }
+  }
+  shards.clear();
+}
+
+/* An IDF_DIC given to option -A or -R whose M and doc_count are added to or
+ * subtracted from the ones being counted
+ */
+struct df_state {
+  const char *path;
+  int is_removed;
+};
+static vector<struct df_state> df_states;
+
+static inline void merge_df_state(const struct df_state *state)
 {
-  word.append(f);
+  class_idf_dic dic;
+  unsigned long m;
+
+  dic.open(state->path, buffer, BUFFER_SIZE);
+  if (dic.is_hashed()) {
+    fatal_error("%s is a hashed IDF_DIC, which has no word", state->path);
+  }
+
+  m = dic.M();
+  if (!state->is_removed) {
+    M += m;
+  } else if (m > M) {
+    fatal_error("%s removes more documents than there are", state->path);
+  } else {
+    M -= m;
+  }
+
+  for (unsigned int i = 0; i < dic.size(); i++) {
+    if (!state->is_removed) {
+      add_df(dic.word(i), dic.word_length(i), dic.doc_count(i));
+    } else {
+      remove_df(dic.word(i), dic.word_length(i), dic.doc_count(i),
+		state->path);
+    }
+  }
 }
 
-static inline void complete_fn(void)
+static int merge_only = 0;
+
+/* Turn the list of TF files in in_stream, or the records of the container
+ * that in_stream is, into jobs. No file in the list is opened here.
+ */
+static inline void list_df_jobs(void)
 {
-  unsigned int pos = word.find(' ');
+  struct df_job job;
 
-  if (pos != word.npos) {
-    word = word.substr(0, pos);
+  job.path = NULL;
+  job.container = NULL;
+  job.record = 0;
+
+  if (!in_stream_has_magic(in_stream, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE)) {
+    tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file);
+    for (class_input_file_paths::iterator path = input_file_paths.begin();
+	 path != input_file_paths.end(); ++path) {
+      job.path = path->c_str();
+      jobs.push_back(job);
+    }
+    return;
   }
 
-  idf_list[word] += 1;
-  word_sorter.push_back(word);
+  struct mapped_container c;
+  size_t length;
+  const char *data;
 
-  word.clear();
+  init_input_context(&c.ctx, in_stream, in_stream_name, buffer, BUFFER_SIZE);
+  data = load_in_stream(&c.ctx, &length, &c.map, &c.map_length);
+  containers.push_back(c);
+  containers.back().reader.open(data, length, in_stream_name);
+
+  job.container = &containers.back().reader;
+  for (size_t i = 0; i < job.container->size(); i++) {
+    job.record = i;
+    jobs.push_back(job);
+  }
+}
+
+/* Count the document frequencies using worker_count threads, and then merge
+ * and sort the per-worker tables using one thread per shard
+ */
+static inline void threaded_df(void)
+{
+  list_df_jobs();
+
+  shards.resize(worker_count);
+  workers = new struct df_worker[worker_count];
+  for (unsigned int i = 0; i < worker_count; i++) {
+    workers[i].buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+    if (workers[i].buffer == NULL) {
+      fatal_error("Insufficient memory");
+    }
+    init_input_context(&workers[i].ctx, NULL, NULL,
+		       workers[i].buffer, BUFFER_SIZE);
+    workers[i].dfs.resize(shards.size());
+    workers[i].doc_count = 0;
+  }
+
+  class_worker_pool pool;
+  pool.run(worker_count, jobs.size(), count_df, NULL);
+
+  M = 0;
+  for (unsigned int i = 0; i < worker_count; i++) {
+    M += workers[i].doc_count;
+  }
+
+  pool.run(worker_count, shards.size(), merge_shard, NULL);
+}
+
+struct output {
+  unsigned int Q;
+  struct sparse_vector_entry e;
+  struct sparse_vector_entry doc_count;
+} __attribute__((packed));
+
+static int output_version = 1;
+static int is_version_given = 0;
+static class_idf_dic_writer v2_writer;
+
+static inline void write_idf(const class_span &word, unsigned int doc_count)
+{
+  struct output o;
+
+  if (output_version == 2) {
+    v2_writer.add(word.data, word.length,
+		  log(static_cast<double>(M) / doc_count), doc_count);
+    return;
+  }
+
+  if (fwrite(word.data, word.length, 1, out_stream) != 1
+      || fputc('\0', out_stream) == EOF) {
+    fatal_syserror("Cannot write word to output stream");
+  }
+
+  o.Q = 2;
+  o.e.offset = 0;
+  o.doc_count.offset = 1;
+  o.doc_count.value = doc_count;
+  o.e.value = log(static_cast<double>(M) / o.doc_count.value);
+  if (fwrite(&o, sizeof(o), 1, out_stream) == 0) {
+    fatal_syserror("Cannot write IDF to output stream");
+  }
+}
+
+/* With the option -B, the IDF_DIC of a fold is derived from the IDF_DIC of
+ * the whole corpus by removing the held-out documents listed in the input
+ * stream, whose term IDs, i.e., their offsets in the IDF_DIC of the corpus,
+ * are taken from the raw w vectors given by -T. Only the entries of the
+ * held-out documents are read, so that the cost is that of their postings.
+ */
+struct term_set {
+  const char *entries;
+  unsigned int count;
+  int is_held_out;
+};
+typedef unordered_map<class_span, struct term_set, span_hash> class_term_sets;
+static const char *base_idf_dic_path = NULL;
+static const char *term_set_path = NULL;
+static class_idf_dic base_idf_dic;
+static class_term_sets term_sets;
+static vector<uint32_t> fold_doc_counts;
+
+static void term_set_fn(const char *name, unsigned int count,
+			const char *entries, void *arg)
+{
+  struct term_set set;
+
+  set.entries = entries;
+  set.count = count;
+  set.is_held_out = 0;
+  term_sets.insert(make_pair(class_span(name, strlen(name)), set));
+}
+
+static inline void hold_out(const char *doc_name)
+{
+  class_term_sets::iterator i
+    = term_sets.find(class_span(doc_name, strlen(doc_name)));
+
+  if (i == term_sets.end()) {
+    fatal_error("Held-out document %s is not in %s", doc_name, term_set_path);
+  }
+  if (i->second.is_held_out) {
+    fatal_error("Document %s is held out twice", doc_name);
+  }
+  i->second.is_held_out = 1;
+
+  if (M == 0) {
+    fatal_error("Document %s removes more documents than there are",
+		doc_name);
+  }
+  M--;
+
+  for (unsigned int j = 0; j < i->second.count; j++) {
+    struct sparse_vector_entry e;
+
+    memcpy(&e, i->second.entries + j * sizeof(e), sizeof(e));
+    if (e.offset >= fold_doc_counts.size()) {
+      fatal_error("Document %s has offset %u out of %s", doc_name, e.offset,
+		  base_idf_dic_path);
+    }
+    if (fold_doc_counts[e.offset] == 0) {
+      fatal_error("Document %s removes offset %u from more documents"
+		  " than there are", doc_name, e.offset);
+    }
+    fold_doc_counts[e.offset]--;
+  }
+}
+
+/* Remove the documents listed in in_stream from the IDF_DIC of the corpus */
+static inline void hold_out_docs(void)
+{
+  struct input_context ctx;
+  void *map;
+  size_t map_length = 0, length;
+  const char *data;
+  unsigned int size;
+
+  init_input_context(&ctx, NULL, NULL, buffer, BUFFER_SIZE);
+  open_input_context(&ctx, term_set_path);
+  data = load_in_stream(&ctx, &length, &map, &map_length);
+  size = index_mapped_vector(data, length, term_set_fn, NULL);
+  if (size != base_idf_dic.size()) {
+    fatal_error("%s has vector size %u but %s has %lu words", term_set_path,
+		size, base_idf_dic_path,
+		static_cast<unsigned long>(base_idf_dic.size()));
+  }
+
+  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file);
+  for (class_input_file_paths::iterator path = input_file_paths.begin();
+       path != input_file_paths.end(); ++path) {
+    hold_out(get_file_name(path->c_str()));
+  }
+
+  term_sets.clear();
+  release_in_stream(&ctx, map, map_length);
+  close_input_context(&ctx);
+  destroy_input_context(&ctx);
+}
+
+/* The offsets of the IDF_DIC of the corpus are kept so that the raw w vectors
+ * of the corpus stay valid for the fold
+ */
+static inline void output_fold(void)
+{
+  if (base_idf_dic.is_hashed()) {
+    class_idf_dic_writer::output_hashed(out_stream, M,
+					base_idf_dic.feature_hashing(),
+					fold_doc_counts);
+    return;
+  }
+
+  for (unsigned int i = 0; i < base_idf_dic.size(); i++) {
+    unsigned int doc_count = fold_doc_counts[i];
+
+    v2_writer.add(base_idf_dic.word(i), base_idf_dic.word_length(i),
+		  doc_count == 0 ? 0 : log(static_cast<double>(M) / doc_count),
+		  doc_count);
+  }
+  v2_writer.output(out_stream, M);
+}
+
+/* With -f, the words are collected in sorted order to be output in the order
+ * of descending doc_count so that the ties stay sorted
+ */
+static int is_frequency_ordered = 0;
+typedef vector<pair<class_span, unsigned int> > class_frequency_sorter;
+static class_frequency_sorter frequency_sorter;
+
+/* Pruning */
+static unsigned int min_df = 1;
+static unsigned int max_df = ~0U;
+static unsigned int selected_feature_count = 0; /* 0 means all */
+enum feature_score {
+  CHI_SQUARE,
+  INFORMATION_GAIN,
+};
+static enum feature_score feature_score = CHI_SQUARE;
+static unordered_set<class_span, span_hash> selected_features;
+
+/* The maximum over the categories of the chi-square statistic of the
+ * independence of the word and the category
+ */
+static inline double get_chi_square(unsigned int df,
+				    const vector<unsigned int> *cat_df)
+{
+  const double N = M;
+  double max = 0;
+
+  for (unsigned int c = 0; c < cat_doc_counts.size(); c++) {
+    double A = cat_df == NULL ? 0 : (*cat_df)[c]; /* in c having the word */
+    double B = df - A; /* not in c having the word */
+    double C = cat_doc_counts[c] - A; /* in c not having the word */
+    double D = N - A - B - C; /* not in c not having the word */
+    double denominator = (A + C) * (B + D) * (A + B) * (C + D);
+
+    if (denominator != 0) {
+      double chi_square = N * (A * D - C * B) * (A * D - C * B) / denominator;
+      if (chi_square > max) {
+	max = chi_square;
+      }
+    }
+  }
+
+  return max;
+}
+
+static inline double p_log_p(double p)
+{
+  return p == 0 ? 0 : p * log(p);
+}
+
+/* The information gain of the categories from knowing whether a document has
+ * the word as defined by Yang and Pedersen (1997)
+ */
+static inline double get_information_gain(unsigned int df,
+					  const vector<unsigned int> *cat_df)
+{
+  const double N = M;
+  double gain = 0;
+
+  for (unsigned int c = 0; c < cat_doc_counts.size(); c++) {
+    double A = cat_df == NULL ? 0 : (*cat_df)[c];
+    double C = cat_doc_counts[c] - A;
+
+    gain -= p_log_p(cat_doc_counts[c] / N);
+    gain += df / N * p_log_p(A / df);
+    if (N > df) {
+      gain += (N - df) / N * p_log_p(C / (N - df));
+    }
+  }
+
+  return gain;
+}
+
+static bool higher_score(const pair<double, class_span> &a,
+			 const pair<double, class_span> &b)
+{
+  return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+/* Select the selected_feature_count words within the DF bounds having the
+ * highest scores, breaking ties in the order of the words
+ */
+static inline void select_features(void)
+{
+  vector<pair<double, class_span> > scores;
+
+  for (class_word_sorter::iterator i = word_sorter.begin();
+       i != word_sorter.end();
+       ++i) {
+    unsigned int df = idf_list[*i];
+
+    if (df == 0 || df < min_df || df > max_df) {
+      continue;
+    }
+
+    class_cat_df_list::const_iterator e = cat_df_list.find(*i);
+    const vector<unsigned int> *cat_df
+      = e == cat_df_list.end() ? NULL : &e->second;
+
+    if (feature_score == CHI_SQUARE) {
+      scores.push_back(make_pair(get_chi_square(df, cat_df), *i));
+    } else {
+      scores.push_back(make_pair(get_information_gain(df, cat_df), *i));
+    }
+  }
+
+  if (scores.size() > selected_feature_count) {
+    partial_sort(scores.begin(), scores.begin() + selected_feature_count,
+		 scores.end(), higher_score);
+    scores.resize(selected_feature_count);
+  }
+
+  for (unsigned int i = 0; i < scores.size(); i++) {
+    selected_features.insert(scores[i].second);
+  }
+}
+
+static inline void output_idf(const class_span &word, unsigned int doc_count)
+{
+  if (doc_count < min_df || doc_count > max_df
+      || (selected_feature_count != 0
+	  && selected_features.find(word) == selected_features.end())) {
+    return;
+  }
+
+  if (is_frequency_ordered) {
+    frequency_sorter.push_back(make_pair(word, doc_count));
+  } else {
+    write_idf(word, doc_count);
+  }
+}
+
+static bool more_frequent(const pair<class_span, unsigned int> &a,
+			  const pair<class_span, unsigned int> &b)
+{
+  return a.second > b.second;
+}
+
+static inline void output_sorted_words(void)
+{
+  sort(word_sorter.begin(), word_sorter.end());
+  for (class_word_sorter::iterator i = word_sorter.begin();
+       i != word_sorter.end();
+       ++i) {
+    unsigned int doc_count = idf_list[*i];
+    if (doc_count != 0) {
+      output_idf(*i, doc_count);
+    }
+  }
+}
+
+/* The shards are sorted, and a word is in only one shard */
+static inline void output_shards(void)
+{
+  vector<size_t> next(shards.size(), 0);
+
+  while (1) {
+    unsigned int min = shards.size();
+
+    for (unsigned int i = 0; i < shards.size(); i++) {
+      if (next[i] < shards[i].sorted.size()
+	  && (min == shards.size()
+	      || (shards[i].sorted[next[i]].first
+		  < shards[min].sorted[next[min]].first))) {
+	min = i;
+      }
+    }
+    if (min == shards.size()) {
+      break;
+    }
+
+    const pair<class_span, unsigned int> &e = shards[min].sorted[next[min]++];
+    output_idf(e.first, e.second);
+  }
+}
+
+/* Output the words in the order of their offsets in a vector */
+static inline void output_words(void)
+{
+  if (!shards.empty()) {
+    output_shards();
+  } else {
+    output_sorted_words();
+  }
+
+  if (is_frequency_ordered) {
+    stable_sort(frequency_sorter.begin(), frequency_sorter.end(),
+		more_frequent);
+    for (class_frequency_sorter::iterator i = frequency_sorter.begin();
+	 i != frequency_sorter.end();
+	 ++i) {
+      write_idf(i->first, i->second);
+    }
+  }
 }
 
 MAIN_BEGIN(
@@ -67,7 +816,13 @@ MAIN_BEGIN(
 "Otherwise, the input file is read for such a list.\n"
 "Then, the each of the file is expected to have the following form:\n"
 "WORD( FIELD)*\\n\n"
-"in which only WORD (i.e., the first field separated by space) matters.\n"
+"in which only WORD (i.e., the first field separated by space) matters,\n"
+"or to be in the binary TF format produced by the TF processing unit with\n"
+"option -b, which is detected automatically.\n"
+"A container of TF files produced by the TF processing unit with option -C\n"
+"can be given either as the input file, which must then be a regular file,\n"
+"in place of the list or as a file in the list. Each of its records is then\n"
+"taken as one TF file.\n"
 "Logically, data should come from one or more TF processing unit in which\n"
 "each TF processing unit produces a list of unique words so that the number\n"
 "of duplicates of a word in the input stream can be taken as the number of\n"
@@ -86,11 +841,11 @@ MAIN_BEGIN(
 "+-----------------------------------------------------------------------+\n"
 "| NULL-terminated string with value: M |C|off_1| M                      |\n"
 "+--------------------------------------+-+-----+-----+-----+------------+\n"
-"| NULL-terminated sorted unique word 1 |Q|off_1|IDF_1|off_2|doc_count_1 |\n"
+"| NULL-terminated unique word 1        |Q|off_1|IDF_1|off_2|doc_count_1 |\n"
 "+--------------------------------------+-+-----+-----+-----+------------+\n"
 "|                                   ...                                 |\n"
 "+--------------------------------------+-+-----+-----+-----+------------+\n"
-"| NULL-terminated sorted unique word N |Q|off_1|IDF_N|off_2|doc_count_N |\n"
+"| NULL-terminated unique word N        |Q|off_1|IDF_N|off_2|doc_count_N |\n"
 "+--------------------------------------+-+-----+-----+-----+------------+\n"
 "C is an unsigned int (4 bytes) datum whose value is 1.\n"
 "Q is an unsigned int (4 bytes) datum whose value is 2.\n"
@@ -103,14 +858,261 @@ MAIN_BEGIN(
 "word_count_i is a double (8 bytes) datum whose value is the number of\n"
 "occurence of word i.\n"
 "The result is output to the given file if an output file is specified.\n"
-"Otherwise, the binary output is output to stdout.\n",
-"",
-"",
+"Otherwise, the binary output is output to stdout.\n"
+"If the option -J is given with THREAD_COUNT > 1, the input files are split\n"
+"among that many threads each of which counts the document frequencies in\n"
+"its own table. The tables are then merged and sorted by THREAD_COUNT\n"
+"threads each of which takes a disjoint part of the vocabulary. The result is\n"
+"the same. In this mode, the whole list is read first. The records of a\n"
+"container given in place of the list are split among the threads as well\n"
+"while a container in the list is counted by one thread.\n"
+"Since an IDF_DIC keeps M and doc_count, it also serves as the state of the\n"
+"document frequencies of the documents it was built from. The option -A,\n"
+"which may be given many times, adds M and every doc_count of the given\n"
+"IDF_DIC to the ones counted from the input files, and the option -R, which\n"
+"may be given many times as well, subtracts them after all additions. A word\n"
+"whose doc_count drops to zero is dropped, and removing a word from more\n"
+"documents than there are is an error. If the option -m is given, no input\n"
+"file is read so that the result only merges the IDF_DICs given to -A and\n"
+"-R. So, a new batch of documents can be taken into account by running this\n"
+"processing unit on the TF files of the new batch only with -A giving the\n"
+"old IDF_DIC, or by merging the IDF_DIC of the new batch with the old one\n"
+"using -m. Merging the IDF_DICs of disjoint sets of documents gives the same\n"
+"result as counting the union of the sets. An IDF_DIC given to -A or -R may\n"
+"be in either format described below.\n"
+"If the option -v is given with VERSION 2, the result is output in the\n"
+"version 2 format instead, which holds the same data laid out to be used in\n"
+"place once memory-mapped (see utility_idf_dic.hpp): a header with M and the\n"
+"number of words followed by a section table, an array of IDF, an array of\n"
+"doc_count, an array of word offsets and a pool of the\n"
+"NULL-terminated words. The w_to_vector processing unit reads both formats.\n"
+"So, running this processing unit with -m -A V1_IDF_DIC -v 2 converts a\n"
+"version 1 IDF_DIC and with -m -A V2_IDF_DIC converts it back.\n"
+"In either format, the offset of a word in a vector is its position in the\n"
+"IDF_DIC. By default, the words are sorted by their bytes. If the option -f\n"
+"is given, the words are ordered by descending doc_count instead, and words\n"
+"having the same doc_count stay sorted by their bytes. Then, the most\n"
+"frequent features get the smallest offsets so that the later processing\n"
+"units touch a smaller part of any array indexed by offset.\n"
+"The dictionary can be pruned as follows, in which case the offsets of the\n"
+"kept words are renumbered while M, IDF and doc_count are unchanged:\n"
+"1. The option -n drops every word whose doc_count is less than MIN_DF.\n"
+"2. The option -x drops every word whose doc_count is more than MAX_DF.\n"
+"3. The option -K keeps only the K words within the DF bounds having the\n"
+"   highest scores against the categories given in DOC_CAT_FILE, which is\n"
+"   specified using the option -C and has the format of the DOC_CAT file of\n"
+"   the rocchio processing unit. A document is looked up in DOC_CAT_FILE by\n"
+"   its file name or, for the record of a container, by its record name, and\n"
+"   a document that is not there has no category. Words having the same\n"
+"   score are kept in the order of their bytes. The option -s selects the\n"
+"   score, which is either chi2 for the maximum over the categories of the\n"
+"   chi-square statistic (the default) or ig for the information gain.\n"
+"   The option -C can only be used together with -K, in which case the input\n"
+"   files are counted by one thread regardless of -J. The option -K cannot\n"
+"   be used together with -A, -R or -m since an IDF_DIC does not keep the\n"
+"   document frequency of a word per category.\n"
+"If the option -S is given, the document frequencies are estimated in about\n"
+"MEMORY MiB regardless of the size of the vocabulary: half of the memory is\n"
+"taken by a count-min sketch that never underestimates a doc_count, and the\n"
+"other half by a table of the words having the largest estimated doc_count\n"
+"(space-saving). Only the words in the table whose estimated doc_count is at\n"
+"least MIN_DF are output with their estimated doc_count, so that the junk\n"
+"words occurring in a few documents need not be kept. The error bounds of\n"
+"the estimates and whether a word having a doc_count of at least MIN_DF may\n"
+"have been lost from the table are reported to stderr. The input files are\n"
+"then counted by one thread regardless of -J. The option -S cannot be used\n"
+"together with -A, -R, -m or -C.\n"
+"If the option -H is given, no word is kept. Instead, every word is hashed\n"
+"to an offset in [0, 2^BITS) by a hash seeded with SEED, which is given by\n"
+"the option -e and defaults to 0, and the result is a hashed IDF_DIC in the\n"
+"version 2 format holding the doc_count and IDF of every offset, in which a\n"
+"document is counted once per offset (see utility_idf_dic.hpp). BITS is at\n"
+"most 30. The w_to_vector processing unit given a hashed IDF_DIC hashes the\n"
+"words in the same way, so that a word that was not in the input files\n"
+"needs no new IDF_DIC. An offset that no input file has gets an IDF of 0.\n"
+"The input files are then counted by one thread regardless of -J, and the\n"
+"option -H can only be used together with -e, -J and -v 2.\n"
+"When the files in the list are counted by one thread, up to FILE_COUNT\n"
+"files after the one being counted are opened ahead by at most 16 other\n"
+"threads, which also read them whole into the page cache, so that the\n"
+"counting does not wait for the storage file by file unless the kernel needs\n"
+"the memory of the page cache back first. FILE_COUNT is given by the option\n"
+"-r and defaults to 8 when more than one processor is online, or 0\n"
+"otherwise, with which every file is opened only when it is counted. With\n"
+"-J, each thread opens the files it counts by itself instead.\n"
+"The result is the same.\n"
+"If the option -B is given, the input stream is instead read for a list of\n"
+"the held-out documents of a cross-validation fold, which are looked up by\n"
+"their file names, and the result is the IDF_DIC of the rest of the corpus\n"
+"whose IDF_DIC is given as BASE_IDF_DIC without reading any TF file: M and\n"
+"the doc_count of every word are those of BASE_IDF_DIC less the ones of the\n"
+"held-out documents, whose term IDs are read from TERM_SET_FILE given by the\n"
+"option -T. TERM_SET_FILE holds the raw w vectors of the corpus produced by\n"
+"the w_to_vector processing unit with -t -D BASE_IDF_DIC, in which every\n"
+"offset having an entry is a term of the document, and only the entries of\n"
+"the held-out documents are read. The words keep their offsets in\n"
+"BASE_IDF_DIC so that TERM_SET_FILE can also be weighted by the result\n"
+"using the option -W of the rocchio and classifier processing units, and a\n"
+"word whose doc_count drops to zero is kept with an IDF of 0 (a hashed\n"
+"BASE_IDF_DIC gives a hashed result). Holding out a document that is not in\n"
+"TERM_SET_FILE or holding out a document twice is an error. The result is\n"
+"the same as counting the TF files of the rest of the corpus, and the option\n"
+"-B can only be used together with -T and -v 2.\n",
+"J:A:R:mv:fn:x:K:C:s:S:H:e:r:B:T:",
+"[-J THREAD_COUNT] [-A IDF_DIC]... [-R IDF_DIC]... [-m] [-v VERSION] [-f]\n"
+" [-n MIN_DF] [-x MAX_DF] [-K K -C DOC_CAT_FILE [-s chi2|ig]] [-S MEMORY]\n"
+" [-H BITS [-e SEED]] [-r FILE_COUNT] [-B BASE_IDF_DIC -T TERM_SET_FILE]",
 0,
+case 'J': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1) {
+    fatal_error("THREAD_COUNT must be >= 1");
+  }
+  worker_count = num;
+}
+break;
+
+case 'A':
+case 'R': {
+  struct df_state state;
+  state.path = optarg;
+  state.is_removed = optchar == 'R';
+  df_states.push_back(state);
+}
+break;
+
+case 'm':
+merge_only = 1;
+break;
+
+case 'f':
+is_frequency_ordered = 1;
+break;
+
+case 'n':
+min_df = strtoul(optarg, NULL, 10);
+break;
+
+case 'x':
+max_df = strtoul(optarg, NULL, 10);
+break;
+
+case 'K': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1) {
+    fatal_error("K must be >= 1");
+  }
+  selected_feature_count = num;
+}
+break;
+
+case 'C':
+doc_cat_path = optarg;
+break;
+
+case 's':
+if (strcmp(optarg, "chi2") == 0) {
+  feature_score = CHI_SQUARE;
+} else if (strcmp(optarg, "ig") == 0) {
+  feature_score = INFORMATION_GAIN;
+} else {
+  fatal_error("The score must be either chi2 or ig");
+}
+break;
+
+case 'S': {
+  double mib = strtod(optarg, NULL);
+  if (!(mib > 0)) {
+    fatal_error("MEMORY must be > 0");
+  }
+  sketch_memory = static_cast<size_t>(mib * 1024 * 1024);
+}
+break;
+
+case 'H': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1 || num > FEATURE_HASHING_MAX_BITS) {
+    fatal_error("BITS must be in [1, %u]", FEATURE_HASHING_MAX_BITS);
+  }
+  hashing.bits = num;
+}
+break;
+
+case 'e':
+hashing.seed = strtoul(optarg, NULL, 10);
+break;
+
+case 'r': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 0) {
+    fatal_error("FILE_COUNT must be >= 0");
+  }
+  prefetch_window = num;
+}
+break;
+
+case 'B':
+base_idf_dic_path = optarg;
+break;
+
+case 'T':
+term_set_path = optarg;
+break;
+
+case 'v':
+is_version_given = 1;
+output_version = atoi(optarg);
+if (output_version != 1 && output_version != 2) {
+  fatal_error("VERSION must be either 1 or 2");
+}
+break;
+
 NO_MORE_CASE
 )
 
-  unsigned long M = 0;
+  if (doc_cat_path != NULL && selected_feature_count == 0) {
+    fatal_error("-C is only used by -K to score the words");
+  }
+  if (selected_feature_count != 0) {
+    if (doc_cat_path == NULL) {
+      fatal_error("-K needs the DOC_CAT_FILE given by -C");
+    }
+    if (!df_states.empty() || merge_only) {
+      fatal_error("-K cannot be used together with -A, -R or -m");
+    }
+  }
+
+  if (hashing.bits != 0) {
+    if (!df_states.empty() || merge_only || is_frequency_ordered
+	|| min_df != 1 || max_df != ~0U || selected_feature_count != 0
+	|| doc_cat_path != NULL || sketch_memory != 0
+	|| (is_version_given && output_version != 2)) {
+      fatal_error("-H can only be used together with -e, -J and -v 2");
+    }
+    output_version = 2;
+    hashed_doc_counts.assign(1UL << hashing.bits, 0);
+    hashed_last_docs.assign(1UL << hashing.bits, 0);
+  }
+
+  if (base_idf_dic_path != NULL || term_set_path != NULL) {
+    if (base_idf_dic_path == NULL || term_set_path == NULL) {
+      fatal_error("-B and -T must be given together");
+    }
+    if (!df_states.empty() || merge_only || is_frequency_ordered
+	|| min_df != 1 || max_df != ~0U || selected_feature_count != 0
+	|| doc_cat_path != NULL || sketch_memory != 0 || hashing.bits != 0
+	|| (is_version_given && output_version != 2)) {
+      fatal_error("-B can only be used together with -T and -v 2");
+    }
+    output_version = 2;
+  }
+
+  if (sketch_memory != 0) {
+    if (!df_states.empty() || merge_only || doc_cat_path != NULL) {
+      fatal_error("-S cannot be used together with -A, -R, -m or -C");
+    }
+    df_sketch.init(sketch_memory);
+  }
 
   /* Allocating tokenizing buffer */
   buffer = static_cast<char *>(malloc(BUFFER_SIZE));
@@ -119,73 +1121,113 @@ NO_MORE_CASE
   }
   /* End of allocation */
 
+  if (doc_cat_path != NULL) {
+    load_doc_cats(doc_cat_path);
+  }
+
+  if (base_idf_dic_path != NULL) {
+    base_idf_dic.open(base_idf_dic_path, buffer, BUFFER_SIZE);
+    M = base_idf_dic.M();
+    fold_doc_counts.resize(base_idf_dic.size());
+    for (unsigned int i = 0; i < base_idf_dic.size(); i++) {
+      fold_doc_counts[i] = base_idf_dic.doc_count(i);
+    }
+  }
+
 MAIN_INPUT_START
+if (merge_only) {
+  /* Only the IDF_DICs given to -A and -R are read */
+} else if (base_idf_dic_path != NULL) {
+  hold_out_docs();
+} else if (worker_count > 1 && doc_cat_path == NULL && sketch_memory == 0
+	   && hashing.bits == 0) {
+  threaded_df();
+} else if (parse_container(buffer, BUFFER_SIZE, record_fn)) {
+  /* The input stream is a container */
+} else {
 MAIN_LIST_OF_FILE_START
 {
-  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn, complete_fn);
-  M++;
+  if (!parse_container(buffer, BUFFER_SIZE, record_fn)) {
+    begin_doc(get_file_name(file_path->c_str()));
+    parse_tf(buffer, BUFFER_SIZE, 0, tf_fn);
+    M++;
+  }
 }
 MAIN_LIST_OF_FILE_END
+}
 MAIN_INPUT_END
 {
-  /* If requested to write an output file, output the header */
-  size_t block_write;
-  unsigned int count = 2;
-  block_write = fwrite(&count, sizeof(count), 1, out_stream);
-  if (block_write == 0) {
-    fatal_syserror("Cannot write normal vector size to output stream");
-  }
+  if (sketch_memory != 0) {
+    const class_heavy_hitters &table = df_sketch.get_table();
 
-  /* End of outputting header */
+    for (unsigned int i = 0; i < table.size(); i++) {
+      if (table.count(i) >= min_df) {
+	add_df(table.word(i).data(), table.word(i).length(), table.count(i));
+      }
+    }
+    df_sketch.report(stderr, min_df);
+  }
 
-  /* Output M */
-  struct output_M {
-    char name[2];
-    unsigned int C;
-    struct sparse_vector_entry e;
-  } __attribute__((packed));
-  struct output_M out_M;
-
-  strcpy(out_M.name, "M");
-  out_M.C = 1;
-  out_M.e.offset = 0;
-  out_M.e.value = M;
-  block_write = fwrite(&out_M, sizeof(out_M), 1, out_stream);
-  if (block_write == 0) {
-    fatal_syserror("Cannot write M to output stream");
-  }
-
-  /* Calculating IDF and the word position in the vector and outputing to
-   * a file if requested
-   */
-  word_sorter.sort();
-  word_sorter.unique();
-
-  struct output {
-    unsigned int Q;
-    struct sparse_vector_entry e;
-    struct sparse_vector_entry doc_count;
-  } __attribute__((packed));
+  if (!df_states.empty()) {
+    if (worker_count > 1) {
+      fold_shards();
+    }
+    for (unsigned int i = 0; i < df_states.size(); i++) {
+      if (!df_states[i].is_removed) {
+	merge_df_state(&df_states[i]);
+      }
+    }
+    for (unsigned int i = 0; i < df_states.size(); i++) {
+      if (df_states[i].is_removed) {
+	merge_df_state(&df_states[i]);
+      }
+    }
+  }
 
-  struct output o;
-  o.Q = 2;
-  o.e.offset = 0;
-  o.doc_count.offset = 1;
-  for (class_word_sorter::iterator i = word_sorter.begin();
-       i != word_sorter.end();
-       ++i) {
+  if (selected_feature_count != 0) {
+    select_features();
+  }
 
-    block_write = fwrite(i->c_str(), i->length() + 1, 1, out_stream);
+  if (base_idf_dic_path != NULL) {
+    output_fold();
+  } else if (hashing.bits != 0) {
+    class_idf_dic_writer::output_hashed(out_stream, M, hashing,
+					hashed_doc_counts);
+  } else if (output_version == 2) {
+    output_words();
+    v2_writer.output(out_stream, M);
+  } else {
+    /* If requested to write an output file, output the header */
+    size_t block_write;
+    unsigned int count = 2;
+    block_write = fwrite(&count, sizeof(count), 1, out_stream);
     if (block_write == 0) {
-      fatal_syserror("Cannot write word to output stream");
+      fatal_syserror("Cannot write normal vector size to output stream");
     }
 
-    o.doc_count.value = idf_list[*i];
-    o.e.value = log(static_cast<double>(M) / o.doc_count.value);
-    block_write = fwrite(&o, sizeof(o), 1, out_stream);
+    /* End of outputting header */
+
+    /* Output M */
+    struct output_M {
+      char name[2];
+      unsigned int C;
+      struct sparse_vector_entry e;
+    } __attribute__((packed));
+    struct output_M out_M;
+
+    strcpy(out_M.name, "M");
+    out_M.C = 1;
+    out_M.e.offset = 0;
+    out_M.e.value = M;
+    block_write = fwrite(&out_M, sizeof(out_M), 1, out_stream);
     if (block_write == 0) {
-      fatal_syserror("Cannot write IDF to output stream");
+      fatal_syserror("Cannot write M to output stream");
     }
+
+    /* Calculating IDF and the word position in the vector and outputing to
+     * a file if requested
+     */
+    output_words();
+    /* End of IDF and word position in the vector calculations */
   }
-  /* End of IDF and word position in the vector calculations */
 } MAIN_END
@@ -19,6 +19,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <vector>
+#include <algorithm>
 #include <unordered_map>
 #include <unordered_set>
 #include <cmath>
@@ -41,6 +42,7 @@ typedef pair<string, class_sparse_vector> class_name_vec_pair;
 typedef unordered_map<string, class_name_vec_pair> class_name_vec_list;
 
 typedef vector<class_name_vec_pair *> class_output_buffer;
+typedef vector<pair<class_sparse_vector_offset, double> > class_sorted_vector;
 static inline void output_buffer_insert(class_name_vec_pair &name_vec,
 					class_output_buffer &buffer)
 {
@@ -72,8 +74,10 @@ static inline void output_result(const class_output_buffer &result,
       }
 
       const class_sparse_vector &vec = name_vec->second;
+      class_sorted_vector sorted_vec(vec.begin(), vec.end());
+      sort(sorted_vec.begin(), sorted_vec.end());
 
-      unsigned int Q = vec.size();
+      unsigned int Q = sorted_vec.size();
       block_write = fwrite(&Q, sizeof(Q), 1, out_stream);
       if (block_write == 0) {
 	fatal_syserror("Cannot output offset count of vector #%u", i_cnt + 1);
@@ -81,8 +85,8 @@ static inline void output_result(const class_output_buffer &result,
 
       unsigned int k_cnt = 0;
       struct sparse_vector_entry e;
-      for (class_sparse_vector::const_iterator k = vec.begin();
-	   k != vec.end();
+      for (class_sorted_vector::const_iterator k = sorted_vec.begin();
+	   k != sorted_vec.end();
 	   k++, k_cnt++)
 	{
 	  e.offset = k->first;
@@ -101,6 +105,7 @@ static inline void output_result(const class_output_buffer &result,
 /* End of outputting result */
 
 static class_name_vec_list name_vec_list; // All input data are stored here
+static class_output_buffer input_order; // The pairs in order of appearance
 
 /* Read (name, sparse vector) pairs */
 static unsigned int vector_size = 0;
@@ -110,7 +115,7 @@ static inline void vector_size_fn(unsigned int size)
 }
 
 static string name;
-static inline void string_partial_fn(char *str)
+static inline void string_partial_fn(const char *str)
 {
   name.append(str);
 }
@@ -118,8 +123,13 @@ static inline void string_partial_fn(char *str)
 static class_sparse_vector *active_vector = NULL;
 static inline void string_complete_fn(void)
 {
-  name_vec_list[name].first = name;
-  active_vector = &name_vec_list[name].second;
+  size_t pair_count = name_vec_list.size();
+  class_name_vec_pair &name_vec = name_vec_list[name];
+  if (name_vec_list.size() != pair_count) {
+    name_vec.first = name;
+    input_order.push_back(&name_vec);
+  }
+  active_vector = &name_vec.second;
   name.clear();
 }
 
@@ -145,9 +155,12 @@ static inline void filtering_partial_fn(char *f)
 
 typedef unordered_set<string> class_filter_file;
 static class_filter_file filter_file;
+static vector<string> filter_order; // The names in order of appearance
 static inline void filtering_complete_fn(void)
 {
-  filter_file.insert(name);
+  if (filter_file.insert(name).second) {
+    filter_order.push_back(name);
+  }
   name.clear();
 }
 /* End of reading filter file */
@@ -164,7 +177,7 @@ static inline void ref_vector_size_fn(unsigned int size)
 }
 
 static string ref_name;
-static inline void ref_string_partial_fn(char *str)
+static inline void ref_string_partial_fn(const char *str)
 {
   ref_name.append(str);
 }
@@ -215,7 +228,7 @@ MAIN_BEGIN(
 "out sparse vectors whose names are given in FILTER_FILE. Each line in\n"
 "FILTER_FILE specifies a name to be filtered out. To invert the filter,\n"
 "specify the optional option -v. In this way, only the pairs whose names are\n"
-"in the FILTER_FILE are output.\n"
+"in the FILTER_FILE are output in the order of their names in FILTER_FILE.\n"
 "The remaining pairs of name and sparse vector are output in the same binary\n"
 "format as the input to stdout if no output file is given, or to the given\n"
 "file otherwise.\n"
@@ -231,15 +244,13 @@ MAIN_BEGIN(
 " | {MISSING A_NAME_IN_THE_REFERENCE_SET_THAT_IS_NOT_IN_THIS_SET\\n}*\n"
 " | {DIFF NAME OFFSET REFERENCE_VALUE THIS_VALUE\\n}*}*\n"
 "If no optional option is given, the given input is simply output.\n"
-"In all operational mode, even if nothing is specified, this processing unit\n"
-"may alter the original positions of the vector entries in a single vector.\n"
-"For example, if the original vector is as follows:\n"
-"+--------+---+---+-----+---+-----+\n"
-"| name_1 | 2 | 3 | 1.2 | 5 | 3.4 |\n"
-"+--------+---+---+-----+---+-----+, it may be altered as follows:\n"
-"+--------+---+---+-----+---+-----+\n"
-"| name_1 | 2 | 5 | 3.4 | 3 | 1.2 |\n"
-"+--------+---+---+-----+---+-----+\n",
+"Unless -v is given, the sparse vectors are output in the order in which\n"
+"their names first appear in the input stream. In any case, the entries of a\n"
+"sparse vector are output in the order of their offsets, which is the order\n"
+"the w_to_vector processing unit outputs them in. So, the pairs picked from\n"
+"the w vectors of the w_to_vector processing unit keep their bytes. A name\n"
+"appearing more than once in the input stream is output once with the\n"
+"entries of all of its appearances.\n",
 "D:vC:t:",
 "[-D FILTER_FILE [-v]] | [-C SET_OF_REFERENCE_VECTORS [-t TOLERANCE]]",
 1,
@@ -304,14 +315,20 @@ MAIN_INPUT_END /* End of reading input stream */
 if (mode == FILTERING) {
   class_output_buffer output_buffer;
 
-  foreach(class_name_vec_list, name_vec_list, name_vec) {
-    if ((!filter_file_inverted
-	 && filter_file.find(name_vec->first) == filter_file.end())
-	|| (filter_file_inverted
-	    && filter_file.find(name_vec->first) != filter_file.end()))
-      {
+  if (filter_file_inverted) {
+    foreach(vector<string>, filter_order, filter_name) {
+      class_name_vec_list::iterator name_vec
+	= name_vec_list.find(*filter_name);
+      if (name_vec != name_vec_list.end()) {
 	output_buffer_insert(name_vec->second, output_buffer);
       }
+    }
+  } else {
+    foreach(class_output_buffer, input_order, name_vec) {
+      if (filter_file.find((*name_vec)->first) == filter_file.end()) {
+	output_buffer_insert(**name_vec, output_buffer);
+      }
+    }
   }
 
   output_result(output_buffer, vector_size);
@@ -361,13 +378,7 @@ if (mode == FILTERING) {
   }
 
 } else { // mode == NOTHING
-  class_output_buffer output_buffer;
-
-  foreach(class_name_vec_list, name_vec_list, name_vec) {
-    output_buffer_insert(name_vec->second, output_buffer);
-  }
-
-  output_result(output_buffer, vector_size);
+  output_result(input_order, vector_size);
 }
 /* End of processing */
 
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <vector>
+#include <unordered_set>
+#include <cstdio>
+#include <cstdlib>
+#include "utility.h"
+#include "utility_span.hpp"
+#include "utility_perfect_hash.hpp"
+
+using namespace std;
+
+static char *buffer = NULL;
+CLEANUP_BEGIN
+{
+  if (buffer != NULL) {
+    free(buffer);
+  }
+} CLEANUP_END
+
+static unordered_set<class_span, span_hash> unique_words;
+static vector<class_span> words;
+static class_string_pool word_pool;
+static const char *table_name = "builtin_stop_list";
+
+static inline void token_fn(const char *f, size_t length)
+{
+  class_span word(f, length);
+
+  if (unique_words.find(word) == unique_words.end()) {
+    word = word_pool.intern(word);
+    unique_words.insert(word);
+    words.push_back(word);
+  }
+}
+
+MAIN_BEGIN(
+"perfect_hash_gen",
+"If input file is not given, stdin is read for input.\n"
+"Otherwise, the input file is read for input.\n"
+"Then, the input stream is expected to contain words separated by a newline\n"
+"character (i.e., '\\n') like the stop list file of the stop_list processing\n"
+"unit. Duplicated words are ignored.\n"
+"The result is C++ source code defining a constexpr perfect_hash_table (see\n"
+"utility_perfect_hash.hpp) of the unique words whose name is given by the\n"
+"option -n, which defaults to builtin_stop_list. The make variable STOP_LIST\n"
+"uses this to compile a stop list into the stop_list processing unit.\n"
+"The result is output to the given file if an output file is specified.\n"
+"Otherwise, the result is output to stdout.\n",
+"n:",
+"[-n NAME]",
+0,
+case 'n':
+table_name = optarg;
+break;
+
+NO_MORE_CASE
+) {
+  /* Allocating tokenizing buffer */
+  buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+  if (buffer == NULL) {
+    fatal_error("Insufficient memory");
+  }
+  /* End of allocation */
+}
+MAIN_INPUT_START
+{
+  tokenizer_span("\n", buffer, BUFFER_SIZE, token_fn);
+}
+MAIN_INPUT_END
+{
+  class_perfect_hash_builder builder;
+  struct perfect_hash_table table;
+
+  builder.build(words, &table);
+
+#ifndef NDEBUG
+  test_perfect_hash_table(&table);
+#endif
+
+  fprintf(out_stream, "/* Generated by perfect_hash_gen; do not edit */\n\n");
+  output_perfect_hash_table(out_stream, &table, table_name);
+}
+MAIN_END
@@ -40,6 +40,8 @@
 #include "utility_doc_cat_list.hpp"
 #include "utility_classifier.hpp"
 #include "utility_threshold_estimation.hpp"
+#include "utility_idf_dic.hpp"
+#include "utility_w_vector.hpp"
 #include "rocchio.hpp"
 
 using namespace std;
@@ -134,6 +136,21 @@ static inline void doc_cat_fn(const string &doc_name, const string &cat_name)
   }
 }
 
+/* With the option -W, the w vectors are raw (see w_to_vector -t) and are
+ * weighted using the IDF_DIC as they are loaded
+ */
+static const char *idf_dic_path = NULL;
+static class_idf_dic idf_dic;
+static class_w_vector_weighting weighting;
+
+static inline void check_raw_vector_size(unsigned int size)
+{
+  if (idf_dic_path != NULL && size != idf_dic.size()) {
+    fatal_error("Raw w vector size (%u) != IDF_DIC size (%lu)",
+		size, static_cast<unsigned long>(idf_dic.size()));
+  }
+}
+
 static unsigned int ES_file_vector_size = 0;
 static const char *ES_file_path = NULL;
 static unsigned int vector_size;
@@ -144,10 +161,11 @@ static inline void vector_size_fn(unsigned int size)
     fatal_error("Input stream vector size (%u) != Custom ES vector size (%u)",
 		vector_size, ES_file_vector_size);
   }
+  check_raw_vector_size(size);
 }
 
 static string word;
-static inline void string_partial_fn(char *str)
+static inline void string_partial_fn(const char *str)
 {
   word.append(str);
 }
@@ -224,11 +242,18 @@ static inline void offset_count_fn(unsigned int count)
 
 static inline void double_fn(unsigned int index, double value)
 {
-  D_ptr->first[index] = value;
+  if (idf_dic_path != NULL) {
+    weighting.add(index, value);
+  } else {
+    D_ptr->first[index] = value;
+  }
 }
 
 static inline void end_of_vector_fn(void)
 {
+  if (idf_dic_path != NULL) {
+    weighting.output(D_ptr->first);
+  }
 }
 
 static inline void output_classifiers(const class_cat_profile_list
@@ -922,9 +947,10 @@ static inline void sum_best_P_per_cat(
 static inline void ES_file_vector_size_fn(unsigned int size)
 {
   ES_file_vector_size = size;
+  check_raw_vector_size(size);
 }
 
-static inline void ES_file_string_partial_fn(char *str)
+static inline void ES_file_string_partial_fn(const char *str)
 {
   word.append(str);
 }
@@ -998,11 +1024,18 @@ static inline void ES_file_offset_count_fn(unsigned int count)
 
 static inline void ES_file_double_fn(unsigned int index, double value)
 {
-  D_ptr->first[index] = value;
+  if (idf_dic_path != NULL) {
+    weighting.add(index, value);
+  } else {
+    D_ptr->first[index] = value;
+  }
 }
 
 static inline void ES_file_end_of_vector_fn(void)
 {
+  if (idf_dic_path != NULL) {
+    weighting.output(D_ptr->first);
+  }
 }
 
 static inline void load_ES_file(const char *path)
@@ -1142,13 +1175,22 @@ MAIN_BEGIN(
 "For example, to plot only categories acq and earn, use -F acq,earn.\n"
 "To plot all categories but acq and earn, use -F ^acq,earn.\n"
 "For each ES, there will be one script having the following name:\n"
-"BEP_HISTORY_FILE.ES_NO.m.\n",
-"D:B:I:M:E:P:S:H:F:J:T:",
+"BEP_HISTORY_FILE.ES_NO.m.\n"
+"If the option -W is given, the w vectors in the input stream and in\n"
+"SPARSE_VECTOR_FILE are expected to be raw w vectors output by the\n"
+"w_to_vector processing unit with the option -t. Each of them is turned into\n"
+"a w vector as it is loaded by multiplying every entry by the IDF of its\n"
+"offset in IDF_DIC_FILE and dividing the result by its Euclidean norm. An\n"
+"entry whose offset has a doc_count of 0 in IDF_DIC_FILE is dropped. Hence,\n"
+"the IDF can come from the training set of a fold without building the w\n"
+"vectors again as long as IDF_DIC_FILE has the offsets of the IDF_DIC the\n"
+"raw w vectors were built with.\n",
+"D:B:I:M:E:P:S:H:F:J:T:W:",
 "-D DOC_CAT_FILE -B INIT_VALUE_OF_P -I INCREMENT_OF_P -M MAX_OF_P\n"
 " (-T SPARSE_VECTOR_FILE | -E ESTIMATION_SETS_COUNT -S RANDOM_SEED\n"
 " -P ES_PERCENTAGE_OF_DOC_IN_[0.000...100.000]\n"
 " -J PARAMETER_TUNING_THREAD_COUNT)\n"
-" [-H BEP_HISTORY_FILE [-F LIST_OF_CAT_NAMES_TO_PLOT]]\n",
+" [-H BEP_HISTORY_FILE [-F LIST_OF_CAT_NAMES_TO_PLOT]] [-W IDF_DIC_FILE]\n",
 0,
 case 'D':
 /* Allocating tokenizing buffer */
@@ -1223,6 +1265,10 @@ case 'T': {
 }
 break;
 
+case 'W':
+idf_dic_path = optarg;
+break;
+
 case 'J': {
   long int num = (long int) strtoul(optarg, NULL, 10);
   if (num < 1) {
@@ -1266,6 +1312,10 @@ break;
   if (tuning_max < 0) {
     fatal_error("-M must be specified (-h for help)");
   }
+  if (idf_dic_path != NULL) {
+    idf_dic.open(idf_dic_path, buffer, BUFFER_SIZE);
+    weighting.init(&idf_dic);
+  }
   if (ES_file_path == NULL) {
     if (!ES_count_set) {
       fatal_error("-E must be specified (-h for help)");
@@ -102,6 +102,9 @@ performance_result=$result_base_dir/performance.csv
 rseed_index_file=$result_base_dir/rseed_index_file.txt
 tmp_timing_file=$result_base_dir/timing.txt
 tmp_performance_file=$result_base_dir/perf.csv
+# The raw w vectors of all documents are built by the first run of Step 3 and
+# then only weighted by the IDF_DIC of each training set (see driver.sh -w)
+raw_w_vectors_dir=$result_base_dir/raw_data/raw_w_vectors
 # End of modifiable parameters that do not affect reproducibility
 
 # Changing the following alters how the experiment is conducted
@@ -262,6 +265,7 @@ function run_crossval_various_ES_percentages {
 	    command+=" -a 2"
 	    command+=" -J $thread_count"
 	    command+=" -l"
+	    command+=" -w $raw_w_vectors_dir"
 	    command+=" -P $percentage"
 	    command+=" -S $ES_rseed"
 	    command+=" -R $cross_rseed"
@@ -354,6 +358,7 @@ function run_crossval_noES {
 	    command+=" -a 2"
 	    command+=" -J $thread_count"
 	    command+=" -l"
+	    command+=" -w $raw_w_vectors_dir"
 	    command+=" -E 0"
 	    command+=" -B $P"
 	    command+=" -I "$(echo $P + 2 | bc)
@@ -447,6 +452,7 @@ function run_various_ES_percentages {
 	    command+=" -a 2"
 	    command+=" -J $thread_count"
 	    command+=" -l"
+	    command+=" -w $raw_w_vectors_dir"
 	    command+=" -P $percentage"
 	    command+=" -S $ES_rseed"
 	    command+=" -D"
@@ -531,6 +537,7 @@ function run_noES {
 	    command+=" -a 2"
 	    command+=" -J $thread_count"
 	    command+=" -l"
+	    command+=" -w $raw_w_vectors_dir"
 	    command+=" -E 0"
 	    command+=" -B $P"
 	    command+=" -I "$(echo $P + 2 | bc)
@@ -16,12 +16,15 @@
  *****************************************************************************/
 
 #include <string>
-#include <unordered_set>
+#include <vector>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include "utility.h"
 #include "utility.hpp"
+#include "utility_container.hpp"
+#include "utility_stop_list.hpp"
+#include "utility_prefetch.hpp"
 
 using namespace std;
 
@@ -33,39 +36,37 @@ CLEANUP_BEGIN
   }
 } CLEANUP_END
 
-static unordered_set<string> stop_list;
-static string word;
+static class_stop_list stop_list;
+static int stream_mode = 0;
 
-static inline void stop_list_partial_fn(char *f)
-{
-  word.append(f);
-}
+/* The words not found in the stop list go to out_stream with -s, or to the
+ * temporary file replacing the file being filtered otherwise
+ */
+static FILE *word_stream = NULL;
+static const char *word_stream_name = NULL;
 
-static inline void stop_list_complete_fn(void)
+static inline void token_fn(const char *f, size_t length)
 {
-  stop_list.insert(word);
-  word.clear();
-}
-
-static inline void load_stop_list_file(const char *filename)
-{
-  open_in_stream(filename);
-
-  tokenizer("\n", buffer, BUFFER_SIZE,
-	    stop_list_partial_fn, stop_list_complete_fn);
+  if (!stop_list.contains(f, length)) {
+    if (fwrite(f, 1, length, word_stream) != length
+	|| fputc('\n', word_stream) == EOF) {
+      fatal_syserror("Cannot write to output %s",
+		     word_stream_name == NULL ? "stdout" : word_stream_name);
+    }
+  }
 }
 
-static inline void partial_fn(char *f)
-{
-  word.append(f);
-}
+static const char *stop_list_path = NULL;
+static const char *container_path = NULL;
+static class_container_writer container;
+static vector<char> record;
 
-static inline void complete_fn(void)
+static inline void record_token_fn(const char *f, size_t length)
 {
-  if (stop_list.find(word) == stop_list.end()) {
-    fprintf(out_stream, "%s\n", word.c_str());
+  if (!stop_list.contains(f, length)) {
+    record.insert(record.end(), f, f + length);
+    record.push_back('\n');
   }
-  word.clear();
 }
 
 MAIN_BEGIN(
@@ -75,41 +76,101 @@ MAIN_BEGIN(
 "Otherwise, the input file is read for such a list.\n"
 "Then, each of the file in the list is expected to contain words separated by\n"
 "a newline character (i.e., '\\n').\n"
-"Each line containing word found in the stop list given by the mandatory\n"
-"option -D is removed from the file modifying the original file.\n"
+"Each line containing word found in the stop list is removed from the file\n"
+"modifying the original file.\n"
 "Once a file processing is completed, the path of the file is output to the\n"
 "given file if an output file is specified, or otherwise, to stdout.\n"
-"The mandatory option -D specifies the name of a file containing words\n"
-"separated by a newline character (i.e., '\\n').\n",
-"D:",
-"-D STOP_LIST_FILE",
+"The option -D specifies the name of a file containing words separated by a\n"
+"newline character (i.e., '\\n') to be used as the stop list. If -D is not\n"
+"given, the stop list compiled in from the file given to the make variable\n"
+"STOP_LIST, which defaults to english.stop, is used.\n"
+"If the option -C is given, each file is left untouched and its remaining\n"
+"words are instead appended as a record named after the file to a single\n"
+"container file CONTAINER_FILE, which the TF processing unit accepts in\n"
+"place of a list of documents. Nothing is then output.\n"
+"If the option -s is given, the input stream itself is instead expected to\n"
+"contain words separated by a newline character, and the words not found in\n"
+"the stop list are output in the same form so that this processing unit can\n"
+"filter the output of the tokenizer processing unit through a pipe without\n"
+"writing any file. The TF processing unit can also filter the words using\n"
+"the same stop list by itself with the option -l.\n"
+"Up to FILE_COUNT files after the one being filtered are opened ahead by at\n"
+"most 16 other threads, which also read them whole into the page cache.\n"
+"FILE_COUNT is given by the option -r and defaults to 8 when more than one\n"
+"processor is online, or 0 otherwise, with which every file is opened only\n"
+"when it is filtered. The result is the same.\n",
+"D:C:sr:",
+"[-D STOP_LIST_FILE] [-C CONTAINER_FILE | -s] [-r FILE_COUNT]",
 0,
+case 's':
+stream_mode = 1;
+break;
+
+case 'C':
+container_path = optarg;
+break;
+
 case 'D':
-/* Allocating tokenizing buffer */
-buffer = static_cast<char *>(malloc(BUFFER_SIZE));
-if (buffer == NULL) {
-  fatal_error("Insufficient memory");
- }
-/* End of allocation */
-
-load_stop_list_file(optarg);
+stop_list_path = optarg;
+break;
+
+case 'r': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 0) {
+    fatal_error("FILE_COUNT must be >= 0");
+  }
+  prefetch_window = num;
+}
 break;
 ) {
 
+  /* Allocating tokenizing buffer */
+  buffer = static_cast<char *>(malloc(BUFFER_SIZE));
   if (buffer == NULL) {
-    fatal_error("-D must be specified (-h for help)");
+    fatal_error("Insufficient memory");
+  }
+  /* End of allocation */
+
+  if (stop_list_path != NULL) {
+    stop_list.load(stop_list_path, buffer, BUFFER_SIZE);
+  }
+
+#ifndef NDEBUG
+  stop_list.test();
+#endif
+
+  if (stream_mode && container_path != NULL) {
+    fatal_error("-C and -s cannot be given together");
+  }
+
+  if (container_path != NULL) {
+    container.open(container_path);
   }
 }
 MAIN_INPUT_START
+if (stream_mode) {
+  word_stream = out_stream;
+  word_stream_name = out_stream_name;
+  tokenizer_span("\n", buffer, BUFFER_SIZE, token_fn);
+} else {
 MAIN_LIST_OF_FILE_START
 {
+  if (container_path != NULL) {
+    record.clear();
+    tokenizer_span("\n", buffer, BUFFER_SIZE, record_token_fn);
+    container.append(get_file_name(file_path->c_str()),
+		     record.empty() ? NULL : &record[0], record.size());
+    continue;
+  }
+
   string tmp_file_name(*file_path);
   tmp_file_name.append(".tmp");
-  open_out_stream(tmp_file_name.c_str());
+  word_stream_name = tmp_file_name.c_str();
+  word_stream = open_local_out_stream(word_stream_name);
 
-  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn, complete_fn);
+  tokenizer_span("\n", buffer, BUFFER_SIZE, token_fn);
 
-  recover_stdout();
+  close_local_out_stream(word_stream, word_stream_name);
   recover_stdin();
 
   if (rename(tmp_file_name.c_str(), file_path->c_str()) != 0) {
@@ -120,5 +181,9 @@ MAIN_LIST_OF_FILE_START
   fprintf(out_stream, "%s\n", get_file_name(file_path->c_str()));
 }
 MAIN_LIST_OF_FILE_END
+}
 MAIN_INPUT_END
+if (container_path != NULL) {
+  container.close();
+}
 MAIN_END
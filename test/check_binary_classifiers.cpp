@@ -38,6 +38,8 @@ CLEANUP_BEGIN
 
 #include "utility_idf_dic.hpp"
 
+static class_idf_dic idf_dic;
+
 typedef pair<string /* cat name */,
 	     pair<double /* Th */,
 		  class_sparse_vector>> class_classifier_list_entry;
@@ -50,7 +52,7 @@ static inline void vector_size_fn(unsigned int size)
   vector_size = size;
 }
 
-static inline void string_partial_fn(char *str)
+static inline void string_partial_fn(const char *str)
 {
   word.append(str);
 }
@@ -125,7 +127,7 @@ static inline void w_complete_fn(void)
 
   check_discrepancy(roi_w_f, my_w_f, "%s %s %f %f %f\n",
 		    active_entry->first.c_str(),
-		    idf_list_reversed.find(w_offset)->second.first.c_str(),
+		    idf_dic.word(w_offset),
 		    diff, roi_w_f, my_w_f);
   
   w_offset++;
@@ -161,7 +163,8 @@ MAIN_BEGIN(
 "2. Deviation in the feature weight will output:\n"
 "CAT_NAME FEATURE ROI_w_f-MY_w_f ROI_w_f MY_w_f\\n\n"
 "To resolve FEATURE from the offset, the mandatory option -R is used to\n"
-"specify the output file produced by idf_dic processing unit.\n",
+"specify the output file produced by idf_dic processing unit, which must not\n"
+"be hashed (see idf_dic -h).\n",
 "D:R:T:",
 "-D ROI_CLASSIFIERS_DIR -R FILE_IDF_DIC -T TOLERATED_DIFF_IN_DOUBLE",
 0,
@@ -178,7 +181,10 @@ if (buffer == NULL) {
  }
 /* End of allocation */
 
-load_idf_dic_file_reversed_mapping(optarg);
+idf_dic.open(optarg, buffer, BUFFER_SIZE);
+if (idf_dic.is_hashed()) {
+  fatal_error("%s is a hashed IDF_DIC, which has no word to report", optarg);
+}
 break;
 
 case 'T':
@@ -0,0 +1,166 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "utility.h"
+
+using namespace std;
+
+CLEANUP_BEGIN
+CLEANUP_END
+
+#define TEXT_SIZE 64
+#define ROUND_COUNT 100000
+
+/* The bytes that the texts are made of, which include uppercase letters that
+ * are delimiters, their lowercase letters and bytes having the high bit set
+ */
+static const char alphabet[] = "AaQqZzXx \n.,-Bb\xC3\xA9\xFFmn09";
+
+static const char *builtin_delimiter_lists[] = {
+  DEFAULT_DELIMITER_LIST,
+  "AQZ \n",
+  "aqz \n",
+  "AqZ.\xFF",
+  "X",
+};
+static vector<string> delimiter_lists;
+
+static unsigned int failure_count = 0;
+
+static inline void check_text(const struct delimiter_class *dc,
+			      const char *delimiter, const char *text,
+			      unsigned int round)
+{
+  char simd[TEXT_SIZE], scalar[TEXT_SIZE];
+  uint64_t simd_mask, scalar_mask = 0;
+
+  memcpy(simd, text, TEXT_SIZE);
+  memcpy(scalar, text, TEXT_SIZE);
+
+  /* A whole block is scanned 16 or 32 bytes at a time when a SIMD scanner is
+   * compiled in while a single byte is always scanned by the scalar scanner
+   */
+  simd_mask = scan_delimiters(dc, simd, TEXT_SIZE);
+  for (unsigned int i = 0; i < TEXT_SIZE; i++) {
+    scalar_mask |= scan_delimiters(dc, scalar + i, 1) << i;
+  }
+
+  if (simd_mask != scalar_mask || memcmp(simd, text, TEXT_SIZE) != 0
+      || memcmp(scalar, text, TEXT_SIZE) != 0) {
+    fprintf(out_stream, "Round %u with delimiters \"%s\" and fold_case %d:"
+	    " masks %016llX and %016llX, text %s\n", round, delimiter,
+	    dc->fold_case, (unsigned long long) simd_mask,
+	    (unsigned long long) scalar_mask,
+	    (memcmp(simd, text, TEXT_SIZE) == 0
+	     && memcmp(scalar, text, TEXT_SIZE) == 0) ? "intact" : "written");
+    failure_count++;
+  }
+}
+
+/* The case folding of a copied token does not depend on the delimiters */
+static inline void check_folding(const char *text, unsigned int round)
+{
+  char simd[TEXT_SIZE], scalar[TEXT_SIZE];
+  int simd_has_upper, scalar_has_upper = 0;
+
+  /* A whole block is folded 16 or 32 bytes at a time when a SIMD folder is
+   * compiled in while a single byte is always folded by the scalar folder
+   */
+  fold_case_copy(simd, text, TEXT_SIZE);
+  simd_has_upper = has_upper_case(text, TEXT_SIZE);
+  for (unsigned int i = 0; i < TEXT_SIZE; i++) {
+    fold_case_copy(scalar + i, text + i, 1);
+    scalar_has_upper = scalar_has_upper || has_upper_case(text + i, 1);
+  }
+
+  if (memcmp(simd, scalar, TEXT_SIZE) != 0
+      || simd_has_upper != scalar_has_upper) {
+    fprintf(out_stream, "Round %u: folded texts %s, uppercase letters found"
+	    " %d and %d\n", round,
+	    memcmp(simd, scalar, TEXT_SIZE) == 0 ? "match" : "differ",
+	    simd_has_upper, scalar_has_upper);
+    failure_count++;
+  }
+}
+
+MAIN_BEGIN(
+"check_tokenizer",
+"If input file is not given, stdin is read for input.\n"
+"Otherwise, the input file is read for input.\n"
+"Then, every line of the input stream is taken as one more delimiter list to\n"
+"check in addition to the built-in ones.\n"
+"The delimiter scanner of the shared tokenizer compiled with the make\n"
+"variable SIMD as in the top directory is checked against the scalar scanner\n"
+"on random texts of 64 bytes using delimiter lists that have uppercase\n"
+"letters with and without case folding. Both must find the same delimiters\n"
+"by the raw bytes and must leave the text intact. The case folding of a\n"
+"copied token compiled with SIMD is also checked against the scalar one on\n"
+"the same texts. Every mismatch is written to the given file if an output\n"
+"file is specified or to stdout otherwise, and the exit status is non-zero\n"
+"if there is any.\n",
+"",
+"",
+0,
+NO_MORE_CASE
+)
+
+  for (unsigned int i = 0;
+       i < sizeof(builtin_delimiter_lists) / sizeof(builtin_delimiter_lists[0]);
+       i++) {
+    delimiter_lists.push_back(builtin_delimiter_lists[i]);
+  }
+
+MAIN_INPUT_START
+{
+  char line[BUFFER_SIZE];
+
+  while (fgets(line, sizeof(line), in_stream) != NULL) {
+    line[strcspn(line, "\n")] = '\0';
+    delimiter_lists.push_back(line);
+  }
+}
+MAIN_INPUT_END
+
+  srand(1);
+  for (unsigned int round = 0; round < ROUND_COUNT; round++) {
+    char text[TEXT_SIZE];
+
+    for (unsigned int i = 0; i < TEXT_SIZE; i++) {
+      text[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+    }
+    check_folding(text, round);
+
+    for (unsigned int i = 0; i < delimiter_lists.size(); i++) {
+      struct delimiter_class dc;
+
+      for (int fold_case = 0; fold_case <= 1; fold_case++) {
+	init_delimiter_class(&dc, delimiter_lists[i].c_str(), fold_case);
+	check_text(&dc, delimiter_lists[i].c_str(), text, round);
+      }
+    }
+  }
+
+  if (failure_count != 0) {
+    fatal_error("%u mismatches", failure_count);
+  }
+
+MAIN_END
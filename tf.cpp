@@ -15,35 +15,517 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *****************************************************************************/
 
+#define THREADED
+
+#include <vector>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include "utility.h"
+#include "utility.hpp"
+#include "utility_term_counter.hpp"
+#include "utility_tf.hpp"
+#include "utility_thread.hpp"
+#include "utility_container.hpp"
+#include "utility_stop_list.hpp"
+#include "utility_content_hash.hpp"
 
 using namespace std;
 
+/* What one worker needs to process a document in the batch mode */
+struct tf_worker {
+  char *buffer;
+  struct input_context ctx;
+  class_term_counter features;
+  vector<char> binary_tf;
+};
+
 static char *buffer = NULL;
+static struct input_context list_ctx;
+static void *list_map = NULL;
+static size_t list_map_length;
+static struct tf_worker *workers = NULL;
+static unsigned int worker_count = 1;
 CLEANUP_BEGIN
 {
   if (buffer != NULL) {
     free(buffer);
   }
+  if (workers != NULL) {
+    for (unsigned int i = 0; i < worker_count; i++) {
+      free(workers[i].buffer);
+      destroy_input_context(&workers[i].ctx);
+    }
+    delete [] workers;
+  }
+  if (list_map != NULL) {
+    release_in_stream(&list_ctx, list_map, list_map_length);
+  }
+  destroy_input_context(&list_ctx);
 } CLEANUP_END
 
-static unordered_map<string, int> feature_list;
-static string word;
+static class_term_counter features;
+static vector<char> binary_tf;
+static int binary_output = 0;
+
+static const char *output_dir = NULL;
+static const char *container_path = NULL;
+static class_container_writer container;
+static class_reorder_buffer container_records;
+static char *delimiter = const_cast<char *>(DEFAULT_DELIMITER_LIST);
+static struct delimiter_class dc;
+static struct delimiter_class newline_dc;
+static vector<string> document_paths;
+static class_container_reader token_lists;
+static int token_list_input = 0;
+static class_stop_list stop_list;
+static int use_stop_list = 0;
+static const char *stop_list_path = NULL;
+
+/* The words are output in the order of their first occurrence. The output is
+ * built in the given buffer to be written at once.
+ */
+static inline void build_tf(const class_term_counter &counter,
+			    vector<char> &out_buffer)
+{
+  out_buffer.clear();
+
+  if (!binary_output) {
+    for (size_t i = 0; i < counter.size(); i++) {
+      const class_term_counter::term &t = counter.get(i);
+      char count[16];
+      int count_length = snprintf(count, sizeof(count), " %u\n", t.count);
+
+      out_buffer.insert(out_buffer.end(), counter.name(t),
+			counter.name(t) + t.length);
+      out_buffer.insert(out_buffer.end(), count, count + count_length);
+    }
+    return;
+  }
+
+  out_buffer.assign(BINARY_TF_MAGIC, BINARY_TF_MAGIC + BINARY_TF_MAGIC_SIZE);
+  for (size_t i = 0; i < counter.size(); i++) {
+    const class_term_counter::term &t = counter.get(i);
+    append_binary_tf_record(out_buffer, counter.name(t), t.length, t.count);
+  }
+}
+
+static inline void write_tf(FILE *out, const char *out_name,
+			    const vector<char> &out_buffer)
+{
+  if (!out_buffer.empty()
+      && fwrite(&out_buffer[0], out_buffer.size(), 1, out) != 1) {
+    fatal_syserror("Cannot write TF to %s", out_name);
+  }
+}
+
+static inline void token_fn(const char *f, size_t length)
+{
+  if (use_stop_list && stop_list.contains(f, length)) {
+    return;
+  }
+
+  features.add(f, length);
+}
+
+/* ROI ignores every single alphanumeric character (see HACKING), which
+ * driver.sh used to filter out with grep -v '^[0-9a-z]$'. When a stop list is
+ * used, only the stop words are dropped as the stop_list processing unit did.
+ */
+static inline void batch_token_fn(const char *f, size_t length, void *arg)
+{
+  struct tf_worker *w = static_cast<struct tf_worker *>(arg);
+
+  if (use_stop_list) {
+    if (stop_list.contains(f, length)) {
+      return;
+    }
+  } else if (length == 1
+	     && ((f[0] >= '0' && f[0] <= '9') || (f[0] >= 'a' && f[0] <= 'z'))) {
+    return;
+  }
+
+  w->features.add(f, length);
+}
+
+/* A document of a container made by stop_list is already a list of words */
+static inline void count_token_list(struct tf_worker *w,
+				    const char *token_list, size_t length)
+{
+  struct token_scanner s;
+  size_t start, end;
+
+  init_token_scanner(&s, &newline_dc, token_list, length);
+  while (scanner_next(&s, &start, &end)) {
+    if (use_stop_list && stop_list.contains(token_list + start, end - start)) {
+      continue;
+    }
+    w->features.add(token_list + start, end - start);
+  }
+}
+
+/* With the option -u, a document whose bytes are the same as those of another
+ * one is counted only once, and every copy takes the result of the one that
+ * is claimed first under its own name. Only the job of the first one is kept
+ * per content, and its result only until the result is written, after which
+ * a copy reads the result back from the output. A worker finding a copy of a
+ * document that another worker is still counting waits for the result.
+ */
+struct content {
+  size_t first_job;
+  int is_done;
+  int is_written;
+  vector<char> tf;
+};
+typedef unordered_map<struct content_key, struct content,
+		      content_key_hash> class_contents;
+static int dedup = 0;
+static class_contents contents;
+static pthread_mutex_t contents_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t content_done = PTHREAD_COND_INITIALIZER;
+
+/* With -C, the content claimed by a job, and the job whose record a copy
+ * takes once its own record is appended (~0 if none)
+ */
+static vector<struct content *> content_of_job;
+static vector<size_t> record_of_copy;
+static vector<char> copied_record;
+
+static inline void lock_contents(void)
+{
+  if (pthread_mutex_lock(&contents_lock) != 0) {
+    fatal_error("Cannot lock content table");
+  }
+}
+
+static inline void unlock_contents(void)
+{
+  if (pthread_mutex_unlock(&contents_lock) != 0) {
+    fatal_error("Cannot unlock content table");
+  }
+}
+
+static inline const char *job_name(size_t job)
+{
+  const char *doc_name;
+
+  if (token_list_input) {
+    const char *token_list;
+    size_t length;
+
+    token_lists.get(job, &doc_name, &token_list, &length);
+  } else {
+    doc_name = get_file_name(document_paths[job].c_str());
+  }
+
+  return doc_name;
+}
+
+static inline string output_path_of(const char *doc_name)
+{
+  string out_path(output_dir);
+
+  out_path.push_back(OS_PATH_DELIMITER);
+  out_path.append(doc_name);
+
+  return out_path;
+}
+
+/* Read the whole file into the given buffer */
+static inline void read_file(struct tf_worker *w, const char *path,
+			     vector<char> &out_buffer)
+{
+  struct input_context ctx;
+  void *map;
+  size_t map_length = 0, length;
+  const char *data;
+
+  init_input_context(&ctx, NULL, NULL, w->buffer, BUFFER_SIZE);
+  open_input_context(&ctx, path);
+  data = load_in_stream(&ctx, &length, &map, &map_length);
+  out_buffer.assign(data, data + length);
+  release_in_stream(&ctx, map, map_length);
+  close_input_context(&ctx);
+  destroy_input_context(&ctx);
+}
+
+/* Two documents having the same content key are compared byte by byte */
+static inline int is_same_document(struct tf_worker *w, size_t job,
+				   const char *data, size_t length)
+{
+  const char *first;
+  size_t first_length;
+
+  if (token_list_input) {
+    const char *doc_name;
+
+    token_lists.get(job, &doc_name, &first, &first_length);
+    return first_length == length && memcmp(first, data, length) == 0;
+  }
+
+  struct input_context ctx;
+  size_t byte_read;
+  int is_same = 1;
+
+  init_input_context(&ctx, NULL, NULL, w->buffer, BUFFER_SIZE);
+  open_input_context(&ctx, document_paths[job].c_str());
+  while (is_same && (byte_read = load_next_text(&ctx)) != 0) {
+    is_same = (byte_read <= length
+	       && memcmp(ctx.buffer, data, byte_read) == 0);
+    data += byte_read;
+    length -= byte_read;
+  }
+  is_same = is_same && length == 0;
+  close_input_context(&ctx);
+  destroy_input_context(&ctx);
+
+  return is_same;
+}
+
+/**
+ * Claim the given bytes of the job to be counted by the worker, or if they are
+ * those of a document claimed before, take its result into the binary_tf of
+ * the worker. With -C, a result that has been written is instead taken when
+ * the record of the job is appended.
+ *
+ * @param is_copied is set to non-zero if the result has been taken
+ *
+ * @return the content whose result must be published using publish_content()
+ * after counting, or NULL if the result has been taken or if the bytes only
+ * have the same content key as those of another document
+ */
+static inline struct content *claim_content(struct tf_worker *w, size_t job,
+					    const char *data, size_t length,
+					    int *is_copied)
+{
+  struct content_key key = content_key_of(data, length);
+  struct content *c;
+  pair<class_contents::iterator, bool> slot;
+  size_t first_job;
+  int is_written;
+
+  *is_copied = 0;
+
+  lock_contents();
+  slot = contents.insert(make_pair(key, content()));
+  c = &slot.first->second;
+  if (slot.second) {
+    c->first_job = job;
+    c->is_done = 0;
+    c->is_written = 0;
+  }
+  first_job = c->first_job;
+  unlock_contents();
+
+  if (slot.second) {
+    return c;
+  }
+  if (!is_same_document(w, first_job, data, length)) {
+    return NULL; // Counted as a document of its own
+  }
+
+  lock_contents();
+  while (!c->is_done) {
+    if (pthread_cond_wait(&content_done, &contents_lock) != 0) {
+      fatal_error("Cannot wait for content table");
+    }
+  }
+  is_written = c->is_written;
+  if (!is_written) {
+    w->binary_tf = c->tf;
+  }
+  unlock_contents();
+
+  if (is_written) {
+    if (container_path != NULL) {
+      w->binary_tf.clear();
+      record_of_copy[job] = first_job;
+    } else {
+      read_file(w, output_path_of(job_name(first_job)).c_str(), w->binary_tf);
+    }
+  }
+  *is_copied = 1;
+
+  return NULL;
+}
+
+static inline void publish_content(struct content *c, const vector<char> &tf)
+{
+  lock_contents();
+
+  c->tf = tf;
+  c->is_done = 1;
+  if (pthread_cond_broadcast(&content_done) != 0) {
+    fatal_error("Cannot signal content table");
+  }
+
+  unlock_contents();
+}
 
-static inline void partial_fn(char *f)
+/* The result of the first document of the content is in the output now */
+static inline void mark_content_written(struct content *c)
 {
-  word.append(f);
+  lock_contents();
+
+  c->is_written = 1;
+  vector<char>().swap(c->tf);
+
+  unlock_contents();
 }
 
-static inline void complete_fn(void)
+/* With -u, a document is read whole to be hashed before being tokenized */
+static inline struct content *count_unique_document(struct tf_worker *w,
+						    size_t job,
+						    int *is_copied)
 {
-  feature_list[word] += 1;
-  word.clear();
+  void *map;
+  size_t map_length = 0, length;
+  const char *text = load_in_stream(&w->ctx, &length, &map, &map_length);
+  struct content *c = claim_content(w, job, text, length, is_copied);
+
+  if (!*is_copied) {
+    tokenizer_text_span_r(&w->ctx, &dc, text, length, batch_token_fn, w);
+  }
+
+  release_in_stream(&w->ctx, map, map_length);
+
+  return c;
+}
+
+static void append_to_container(size_t job, const vector<char> &tf,
+				void *arg)
+{
+  if (dedup && record_of_copy[job] != ~static_cast<size_t>(0)) {
+    container.append_copy(job_name(job), record_of_copy[job], copied_record);
+    return;
+  }
+
+  container.append(job_name(job), tf.empty() ? NULL : &tf[0], tf.size());
+
+  if (dedup && content_of_job[job] != NULL) {
+    mark_content_written(content_of_job[job]);
+  }
+}
+
+static void tf_of_document(size_t job, unsigned int worker, void *arg)
+{
+  struct tf_worker *w = &workers[worker];
+  struct content *c = NULL;
+  int is_copied = 0;
+
+  if (token_list_input) {
+    const char *doc_name;
+    const char *token_list;
+    size_t length;
+
+    token_lists.get(job, &doc_name, &token_list, &length);
+    if (dedup) {
+      c = claim_content(w, job, token_list, length, &is_copied);
+    }
+    if (!is_copied) {
+      count_token_list(w, token_list, length);
+    }
+  } else {
+    open_input_context(&w->ctx, document_paths[job].c_str());
+    if (dedup) {
+      c = count_unique_document(w, job, &is_copied);
+    } else {
+      tokenizer_class_span_r(&w->ctx, &dc, batch_token_fn, w);
+    }
+    close_input_context(&w->ctx);
+  }
+
+  if (!is_copied) {
+    build_tf(w->features, w->binary_tf);
+    w->features.reset();
+    if (c != NULL) {
+      publish_content(c, w->binary_tf);
+    }
+  }
+
+  if (container_path != NULL) {
+    if (dedup) {
+      content_of_job[job] = c;
+    }
+    container_records.submit(job, w->binary_tf);
+    return;
+  }
+
+  string out_path = output_path_of(job_name(job));
+  FILE *out = open_local_out_stream(out_path.c_str());
+  write_tf(out, out_path.c_str(), w->binary_tf);
+  close_local_out_stream(out, out_path.c_str());
+
+  if (c != NULL) {
+    mark_content_written(c);
+  }
+}
+
+static inline void batch_tf(void)
+{
+  size_t job_count;
+
+  if (in_stream_has_magic(in_stream, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE)) {
+    size_t length;
+    const char *data;
+
+    init_input_context(&list_ctx, in_stream, in_stream_name,
+		       buffer, BUFFER_SIZE);
+    data = load_in_stream(&list_ctx, &length, &list_map, &list_map_length);
+    token_lists.open(data, length, in_stream_name);
+    token_list_input = 1;
+    job_count = token_lists.size();
+  } else {
+    tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file);
+    document_paths.assign(input_file_paths.begin(), input_file_paths.end());
+    input_file_paths.clear();
+    job_count = document_paths.size();
+  }
+
+  /* With -O, a copy reads the result of the first document back from the
+   * file named after the first document, which must then be its own
+   */
+  if (output_dir != NULL && dedup) {
+    unordered_set<string> names;
+
+    for (size_t job = 0; job < job_count; job++) {
+      if (!names.insert(job_name(job)).second) {
+	fatal_error("-u cannot be given with -O since two documents are"
+		    " named %s", job_name(job));
+      }
+    }
+  }
+
+  workers = new struct tf_worker[worker_count];
+  for (unsigned int i = 0; i < worker_count; i++) {
+    workers[i].buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+    if (workers[i].buffer == NULL) {
+      fatal_error("Insufficient memory");
+    }
+    init_input_context(&workers[i].ctx, NULL, NULL,
+		       workers[i].buffer, BUFFER_SIZE);
+  }
+
+  if (container_path != NULL && dedup) {
+    content_of_job.assign(job_count, NULL);
+    record_of_copy.assign(job_count, ~static_cast<size_t>(0));
+  }
+
+  if (container_path != NULL) {
+    container.open(container_path);
+    container_records.init(REORDER_WINDOW_PER_WORKER * worker_count,
+			   append_to_container, NULL);
+  }
+
+  class_worker_pool pool;
+  pool.run(worker_count, job_count, tf_of_document, NULL);
+
+  if (container_path != NULL) {
+    container.close();
+  }
 }
 
 MAIN_BEGIN(
@@ -56,11 +538,88 @@ MAIN_BEGIN(
 "Next, this processing unit counts the occurence of every unique word.\n"
 "The result takes the following form:\n"
 "UNIQUE_WORD WORD_COUNT\\n\n"
+"in which the words are in the order of their first occurrence,\n"
+"or if the option -b is given, in the binary TF format, which idf_dic and\n"
+"w_to_vector detect automatically by its first four bytes \\0TF\\1,\n"
 "and the result is output to stdout if no output file is given. Otherwise,\n"
-"the result is output to the given file.\n",
-"",
-"",
+"the result is output to the given file.\n"
+"If the option -O is given, the input stream is instead expected to contain\n"
+"a list of paths of documents separated by a newline character. Each\n"
+"document is tokenized like the tokenizer processing unit does using the\n"
+"delimiter list given by the option -d, which has the same default value and\n"
+"syntax as that of the tokenizer processing unit, and then every token\n"
+"consisting of a single character in [0-9a-z] is dropped. The result of\n"
+"each document is output to a file in OUTPUT_DIR whose name is that of the\n"
+"document. The documents are processed by the number of threads given by\n"
+"the option -J, which defaults to 1.\n"
+"If the option -C is given instead of -O, the results of all documents are\n"
+"stored as the records of a single container file CONTAINER_FILE in the\n"
+"order of the list, which idf_dic and w_to_vector accept in place of the\n"
+"TF files. With -O or -C, the input stream can also be a container produced\n"
+"by the stop_list processing unit with the option -C whose records are\n"
+"lists of words of documents separated by a newline character. Each record\n"
+"is then counted as is like a single document is, and the result takes the\n"
+"name of the record.\n"
+"If the option -l is given, every word found in the stop list compiled into\n"
+"the stop_list processing unit is dropped before being counted, and with -O\n"
+"or -C, single characters in [0-9a-z] are no longer dropped unless they are\n"
+"in the stop list. The option -D gives a file of stop words separated by a\n"
+"newline character to be used instead and implies -l. So, the tokenizer and\n"
+"stop_list processing units need not write the words of each document into\n"
+"a file before it is counted.\n"
+"If the option -u is given with -O or -C, a document whose bytes are the\n"
+"same as those of another document, such as a mirror of a web page or a\n"
+"document listed in many category directories under different names, is\n"
+"tokenized and counted only once, and every copy gets the same result under\n"
+"its own name. Two documents having the same length and the same 64-bit\n"
+"xxHash of their bytes are compared byte by byte to be taken as the same.\n"
+"The result of a distinct document is kept in memory only until it is\n"
+"written, after which a copy reads the result back from the output. So,\n"
+"with -O, no two documents may have the same name.\n"
+"The results are the same as those without -u.\n",
+"bO:C:J:d:lD:u",
+"[-b] [-l] [-D STOP_LIST_FILE] [-O OUTPUT_DIR | -C CONTAINER_FILE]\n"
+" [-J THREAD_COUNT] [-d DELIMITER_LIST] [-u]",
 0,
+case 'l':
+use_stop_list = 1;
+break;
+
+case 'D':
+use_stop_list = 1;
+stop_list_path = optarg;
+break;
+
+case 'b':
+binary_output = 1;
+break;
+
+case 'u':
+dedup = 1;
+break;
+
+case 'O':
+output_dir = optarg;
+break;
+
+case 'C':
+container_path = optarg;
+break;
+
+case 'J': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1) {
+    fatal_error("THREAD_COUNT must be >= 1");
+  }
+  worker_count = num;
+}
+break;
+
+case 'd':
+delimiter = optarg;
+unescape_delimiter_list(delimiter);
+break;
+
 NO_MORE_CASE
 ) {
   /* Allocate tokenizing buffer */
@@ -68,17 +627,36 @@ NO_MORE_CASE
   if (buffer == NULL) {
     fatal_error("Insufficient memory");
   }
+
+  if (output_dir != NULL && container_path != NULL) {
+    fatal_error("-O and -C cannot be given together");
+  }
+
+  if (dedup && output_dir == NULL && container_path == NULL) {
+    fatal_error("-u can only be used together with -O or -C");
+  }
+
+  if (stop_list_path != NULL) {
+    stop_list.load(stop_list_path, buffer, BUFFER_SIZE);
+  }
+
+  /* The tokens are lowercased as they are copied out of the text */
+  init_delimiter_class(&dc, delimiter, 1);
+  init_delimiter_class(&newline_dc, "\n", 0);
+  init_input_context(&list_ctx, NULL, NULL, NULL, 0);
 }
 MAIN_INPUT_START
 {
-  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn, complete_fn);
+  if (output_dir == NULL && container_path == NULL) {
+    tokenizer_span("\n", buffer, BUFFER_SIZE, token_fn);
+  } else {
+    batch_tf();
+  }
 }
 MAIN_INPUT_END
-{
-  for (unordered_map<string, int>::const_iterator i = feature_list.cbegin();
-       i != feature_list.end();
-       ++i) {
-    fprintf(out_stream, "%s %d\n", i->first.c_str(), i->second);
-  }
+if (output_dir == NULL && container_path == NULL) {
+  build_tf(features, binary_tf);
+  write_tf(out_stream, out_stream_name == NULL ? "stdout" : out_stream_name,
+	   binary_tf);
 }
 MAIN_END
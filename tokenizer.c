@@ -16,7 +16,6 @@
  *****************************************************************************/
 
 #include <sys/types.h>
-#include <ctype.h>
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -32,22 +31,11 @@ CLEANUP_BEGIN
   }
 } CLEANUP_END
 
-static char *delimiter = "+/ ,.-;:?!<>()[]\"'{}\r\n\t\v";
-
-static inline void strtolower(char *s)
-{
-  int i = 0;
-
-  while (s[i] != '\0') {
-    s[i] = tolower(s[i]);
-    i++;
-  }
-}
+static char *delimiter = DEFAULT_DELIMITER_LIST;
+static struct delimiter_class dc;
 
 static inline void partial_fn(char *f)
 {
-  strtolower(f);
-
   if (fprintf(out_stream, "%s", f) < 0) { // Print the token out
     fatal_error("Error writing %s", out_stream_name);
   }
@@ -77,34 +65,24 @@ MAIN_BEGIN(
 0,
 case 'd':
 delimiter = optarg;
-/* Converting C control characters */
-int i = 0;
-int j = 0;
-char hexdigit[3] = {0};
-while (delimiter[i] != '\0') {
-  if (delimiter[i] == '\\') {
-    strncpy(hexdigit, &delimiter[i + 1], 2);
-    delimiter[j] = strtoul(hexdigit, NULL, 16);
-    i += 3;
-    j++;
-    continue;
-  }
-  delimiter[j] = delimiter[i];
-  i++;
-  j++;
- }
-delimiter[j] = '\0';
-/* End of conversion */
+unescape_delimiter_list(delimiter);
 break;
 ) {
   d = malloc(BUFFER_SIZE); // Allocate tokenizing buffer
   if (d == NULL) {
     fatal_error("Insufficient memory");
   }
+
+  /* The tokens are lowercased as they are copied out of the text */
+  init_delimiter_class(&dc, delimiter, 1);
+
+#ifndef NDEBUG
+  test_scan_delimiters(delimiter);
+#endif
 }
 MAIN_INPUT_START
 {
-  tokenizer(delimiter, d, BUFFER_SIZE, partial_fn, complete_fn);
+  tokenizer_class(&dc, d, BUFFER_SIZE, partial_fn, complete_fn);
 }
 MAIN_INPUT_END
 MAIN_END
@@ -18,14 +18,23 @@
 #ifndef UTILITY_H
 #define UTILITY_H
 
+#include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #ifdef THREADED
 #include <pthread.h>
 #endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
 
 #define FP_COMPARISON_DELTA 1e-15
 
@@ -261,6 +270,65 @@ static inline void close_local_out_stream(FILE *local_out_stream,
   }
 }
 
+/* Everything needed to read an input stream. Unlike in_stream and friends,
+ * a context is not shared, so different threads can read different input
+ * streams at the same time by using different contexts.
+ */
+struct input_context {
+  FILE *stream;
+  const char *stream_name;
+  char *buffer; /* the tokenizing buffer allocated by the owner */
+  size_t buffer_size;
+  char *carry; /* a token straddling two loads of the tokenizing buffer */
+  size_t carry_length;
+  size_t carry_size;
+  char *folded; /* a case-folded token of a read-only text */
+  size_t folded_size;
+};
+
+static inline void init_input_context(struct input_context *ctx,
+				      FILE *stream, const char *stream_name,
+				      char *buffer, size_t buffer_size)
+{
+  ctx->stream = stream;
+  ctx->stream_name = stream_name;
+  ctx->buffer = buffer;
+  ctx->buffer_size = buffer_size;
+  ctx->carry = NULL;
+  ctx->carry_length = 0;
+  ctx->carry_size = 0;
+  ctx->folded = NULL;
+  ctx->folded_size = 0;
+}
+
+static inline void destroy_input_context(struct input_context *ctx)
+{
+  free(ctx->carry);
+  ctx->carry = NULL;
+  ctx->carry_size = 0;
+  free(ctx->folded);
+  ctx->folded = NULL;
+  ctx->folded_size = 0;
+}
+
+static inline void open_input_context(struct input_context *ctx,
+				      const char *path)
+{
+  ctx->stream_name = path;
+  ctx->stream = fopen(path, "r");
+  if (ctx->stream == NULL) {
+    fatal_syserror("Cannot open input %s for reading", path);
+  }
+}
+
+static inline void close_input_context(struct input_context *ctx)
+{
+  if (fclose(ctx->stream) != 0) {
+    fatal_syserror("Cannot close input %s", ctx->stream_name);
+  }
+  ctx->stream = NULL;
+}
+
 /* Taken from http://eternallyconfuzzled.com/arts/jsw_art_rand.aspx
  * in public domain (2010 January 30)
  */
@@ -270,23 +338,430 @@ static inline double uniform_deviate(int seed)
 }
 
 /**
- * @return zero if nothing is read from input stream or non-zero otherwise
+ * @return the number of bytes read from input stream into the buffer that is
+ * then NULL-terminated, which is zero if nothing is read
  */
-static inline int load_next_text(char *buffer, size_t buffer_size)
+static inline size_t load_next_text(struct input_context *ctx)
 {
-  size_t block_read;
+  size_t byte_read;
 
-  memset(buffer, 0, buffer_size); // Clear tokenizing buffer
-  block_read = fread(buffer, buffer_size - 1, 1, in_stream); // Read next chars
-  if (ferror(in_stream)) {
+  byte_read = fread(ctx->buffer, 1, ctx->buffer_size - 1,
+		    ctx->stream); // Read next chars
+  if (ferror(ctx->stream)) {
     fatal_error("Error reading input stream");
   }
+  ctx->buffer[byte_read] = '\0';
+
+  return byte_read;
+}
+
+/**
+ * Map the unread part of the input stream of the context into memory when the
+ * input stream is a non-empty regular file so that it can be walked in place
+ * without any buffering. The mapping is read-only so that no page is ever
+ * copied; a token must be copied before it is modified or NULL-terminated.
+ * Once mapped, the input stream is regarded as completely read.
+ *
+ * @param length is set to the number of unread bytes
+ * @param map is set to the mapping to be given to unmap_in_stream()
+ * @param map_length is set to the length of the mapping
+ *
+ * @return the first unread byte or NULL if the input stream must be read
+ * using the stdio facility (e.g., it is a pipe)
+ */
+static inline const char *map_in_stream(struct input_context *ctx,
+					size_t *length,
+					void **map, size_t *map_length)
+{
+#ifdef DONT_MMAP
+  return NULL;
+#else
+  struct stat st;
+  off_t pos;
+
+  if (fstat(fileno(ctx->stream), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return NULL;
+  }
+
+  pos = ftello(ctx->stream);
+  if (pos < 0 || pos >= st.st_size) {
+    return NULL;
+  }
+
+  *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(ctx->stream),
+	      0);
+  if (*map == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(*map, st.st_size, MADV_SEQUENTIAL);
+
+  if (fseeko(ctx->stream, 0, SEEK_END) != 0) {
+    fatal_syserror("Cannot seek input %s", ctx->stream_name);
+  }
+
+  *map_length = st.st_size;
+  *length = st.st_size - pos;
+
+  return (const char *) *map + pos;
+#endif
+}
+
+static inline void unmap_in_stream(struct input_context *ctx,
+				   void *map, size_t map_length)
+{
+  if (munmap(map, map_length) != 0) {
+    fatal_syserror("Cannot unmap input %s", ctx->stream_name);
+  }
+}
+
+/* The delimiter list given to the tokenizer is turned into a 256-bit class
+ * table so that a byte can be classified with one lookup instead of a strchr()
+ * over the whole list. The same table is also laid out as two 16-entry rows
+ * indexed by the low nibble of a byte whose bit (high nibble modulo 8) tells
+ * whether the byte is a delimiter. This layout lets PSHUFB classify 16 (SSE) or
+ * 32 (AVX2) bytes at once for an arbitrary delimiter list given at runtime.
+ * The NULL character is always a delimiter as it always was for strtok().
+ */
+struct delimiter_class {
+  unsigned char row_lo[16] __attribute__((aligned(16))); /* high nibble 0-7 */
+  unsigned char row_hi[16] __attribute__((aligned(16))); /* high nibble 8-F */
+  uint64_t bitmap[4];
+  int fold_case; /* a token's ASCII uppercase letters become lowercase ones */
+};
 
-  return (block_read || buffer[0] != '\0');
+/* The delimiter list used to tokenize documents when none is given */
+#define DEFAULT_DELIMITER_LIST "+/ ,.-;:?!<>()[]\"'{}\r\n\t\v"
+
+/* Replace in place every two hexadecimal digits preceded by a backslash in
+ * the delimiter list with the character having that value (e.g., \0a becomes
+ * a newline character).
+ */
+static inline void unescape_delimiter_list(char *delimiter)
+{
+  int i = 0;
+  int j = 0;
+  char hexdigit[3] = {0};
+
+  while (delimiter[i] != '\0') {
+    if (delimiter[i] == '\\') {
+      strncpy(hexdigit, &delimiter[i + 1], 2);
+      delimiter[j] = strtoul(hexdigit, NULL, 16);
+      i += 3;
+      j++;
+      continue;
+    }
+    delimiter[j] = delimiter[i];
+    i++;
+    j++;
+  }
+  delimiter[j] = '\0';
 }
 
+static inline void init_delimiter_class(struct delimiter_class *dc,
+					const char *delimiter, int fold_case)
+{
+  const unsigned char *c = (const unsigned char *) delimiter;
+
+  memset(dc, 0, sizeof(*dc));
+  dc->fold_case = fold_case;
+
+  do {
+    dc->bitmap[*c >> 6] |= (uint64_t) 1 << (*c & 63);
+    if (*c < 0x80) {
+      dc->row_lo[*c & 0x0F] |= 1 << (*c >> 4);
+    } else {
+      dc->row_hi[*c & 0x0F] |= 1 << ((*c >> 4) - 8);
+    }
+  } while (*c++ != '\0');
+}
+
+static inline int is_delimiter(const struct delimiter_class *dc, char c)
+{
+  unsigned char u = (unsigned char) c;
+
+  return (dc->bitmap[u >> 6] >> (u & 63)) & 1;
+}
+
+#if defined(__AVX2__)
+static inline uint32_t scan_delimiters_32(const struct delimiter_class *dc,
+					  const char *s)
+{
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  const __m256i row_lo
+    = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) dc->row_lo));
+  const __m256i row_hi
+    = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i *) dc->row_hi));
+  const __m256i bit = _mm256_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+				       1, 2, 4, 8, 16, 32, 64, -128,
+				       1, 2, 4, 8, 16, 32, 64, -128,
+				       1, 2, 4, 8, 16, 32, 64, -128);
+  __m256i v = _mm256_loadu_si256((const __m256i *) s);
+  __m256i lo = _mm256_and_si256(v, nibble);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+  __m256i row = _mm256_blendv_epi8(_mm256_shuffle_epi8(row_lo, lo),
+				   _mm256_shuffle_epi8(row_hi, lo), v);
+  __m256i b = _mm256_shuffle_epi8(bit, hi);
+
+  return _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_and_si256(row, b), b));
+}
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+static inline uint32_t scan_delimiters_16(const struct delimiter_class *dc,
+					  const char *s)
+{
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i row_lo = _mm_load_si128((const __m128i *) dc->row_lo);
+  const __m128i row_hi = _mm_load_si128((const __m128i *) dc->row_hi);
+  const __m128i bit = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128,
+				    1, 2, 4, 8, 16, 32, 64, -128);
+  __m128i v = _mm_loadu_si128((const __m128i *) s);
+  __m128i lo = _mm_and_si128(v, nibble);
+  __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+  __m128i row = _mm_blendv_epi8(_mm_shuffle_epi8(row_lo, lo),
+				_mm_shuffle_epi8(row_hi, lo), v);
+  __m128i b = _mm_shuffle_epi8(bit, hi);
+
+  return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(row, b), b));
+}
+#endif
+
 /**
- * Tokenize the input stream and call the callback functions for each token.
+ * Classify the first n bytes of s (n is at most 64) by their raw values
+ * without writing to s, which may be a read-only mapping.
+ *
+ * @return a mask whose bit i is set if s[i] is a delimiter
+ */
+static inline uint64_t scan_delimiters(const struct delimiter_class *dc,
+				       const char *s, size_t n)
+{
+  uint64_t mask = 0;
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    mask |= (uint64_t) scan_delimiters_32(dc, s + i) << i;
+  }
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+  for (; i + 16 <= n; i += 16) {
+    mask |= (uint64_t) scan_delimiters_16(dc, s + i) << i;
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (is_delimiter(dc, s[i])) {
+      mask |= (uint64_t) 1 << i;
+    }
+  }
+
+  return mask;
+}
+
+/* A token is case-folded only once it has been found in the read-only text,
+ * when it is copied, so that the scanner above never writes to the text.
+ * The copy is then folded 32 or 16 bytes at a time like the scan: a byte is
+ * an ASCII uppercase letter if it is between 'A' and 'Z' as a signed byte,
+ * which a byte having the high bit set never is.
+ */
+#if defined(__AVX2__)
+static inline __m256i upper_case_32(__m256i v)
+{
+  return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+			  _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+}
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+static inline __m128i upper_case_16(__m128i v)
+{
+  return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+		       _mm_cmpgt_epi8(_mm_set1_epi8('Z' + 1), v));
+}
+#endif
+
+static inline int is_upper_case(char c)
+{
+  return c >= 'A' && c <= 'Z';
+}
+
+/* Copy n bytes turning every ASCII uppercase letter into a lowercase one. The
+ * destination may be the source to fold in place.
+ */
+static inline void fold_case_copy(char *dst, const char *src, size_t n)
+{
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  const __m256i distance = _mm256_set1_epi8('a' - 'A');
+
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (src + i));
+
+    v = _mm256_add_epi8(v, _mm256_and_si256(upper_case_32(v), distance));
+    _mm256_storeu_si256((__m256i *) (dst + i), v);
+  }
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+  const __m128i distance = _mm_set1_epi8('a' - 'A');
+
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (src + i));
+
+    v = _mm_add_epi8(v, _mm_and_si128(upper_case_16(v), distance));
+    _mm_storeu_si128((__m128i *) (dst + i), v);
+  }
+#endif
+
+  for (; i < n; i++) {
+    char c = src[i];
+
+    dst[i] = is_upper_case(c) ? c + ('a' - 'A') : c;
+  }
+}
+
+/**
+ * @return non-zero if any of the n bytes is an ASCII uppercase letter
+ */
+static inline int has_upper_case(const char *s, size_t n)
+{
+  size_t i = 0;
+
+#if defined(__AVX2__)
+  for (; i + 32 <= n; i += 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (s + i));
+
+    if (_mm256_movemask_epi8(upper_case_32(v)) != 0) {
+      return 1;
+    }
+  }
+#elif defined(__SSSE3__) && defined(__SSE4_1__)
+  for (; i + 16 <= n; i += 16) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (s + i));
+
+    if (_mm_movemask_epi8(upper_case_16(v)) != 0) {
+      return 1;
+    }
+  }
+#endif
+
+  for (; i < n; i++) {
+    if (is_upper_case(s[i])) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+/* Walks a text 64 bytes at a time keeping the delimiter mask of the block
+ * being walked so that token boundaries are found by counting trailing zeros.
+ */
+struct token_scanner {
+  const struct delimiter_class *dc;
+  const char *text;
+  size_t length;
+  size_t position;
+  size_t block; /* offset of the block whose mask is cached */
+  uint64_t mask;
+};
+
+static inline void init_token_scanner(struct token_scanner *s,
+				      const struct delimiter_class *dc,
+				      const char *text, size_t length)
+{
+  s->dc = dc;
+  s->text = text;
+  s->length = length;
+  s->position = 0;
+  s->block = (size_t) -1;
+  s->mask = 0;
+}
+
+/* Return the offset of the first delimiter (or non-delimiter if delimiter is
+ * zero) at or after pos, or the text length if there is none.
+ */
+static inline size_t scanner_find(struct token_scanner *s, size_t pos,
+				  int delimiter)
+{
+  while (pos < s->length) {
+    size_t block = pos & ~(size_t) 63;
+    uint64_t bits;
+
+    if (block != s->block) {
+      size_t n = s->length - block;
+
+      if (n >= 64) {
+	s->mask = scan_delimiters(s->dc, s->text + block, 64);
+      } else { // Bytes beyond the text are regarded as delimiters
+	s->mask = scan_delimiters(s->dc, s->text + block, n);
+	s->mask |= ~(uint64_t) 0 << n;
+      }
+      s->block = block;
+    }
+
+    bits = (delimiter ? s->mask : ~s->mask) & (~(uint64_t) 0 << (pos - block));
+    if (bits != 0) {
+      pos = block + __builtin_ctzll(bits);
+      return pos < s->length ? pos : s->length;
+    }
+
+    pos = block + 64;
+  }
+
+  return s->length;
+}
+
+/**
+ * Find the next token [*start, *end) in the text. If *end is the text length,
+ * the token may continue beyond the text.
+ *
+ * @return zero if there is no more token or non-zero otherwise
+ */
+static inline int scanner_next(struct token_scanner *s,
+			       size_t *start, size_t *end)
+{
+  *start = scanner_find(s, s->position, 0);
+  if (*start == s->length) {
+    s->position = s->length;
+    return 0;
+  }
+
+  *end = scanner_find(s, *start + 1, 1);
+  s->position = *end;
+
+  return 1;
+}
+
+/* The mapping is read-only, and so, every token is copied into the tokenizing
+ * buffer piece by piece to be NULL-terminated (and case-folded if requested).
+ */
+static inline void tokenize_mapped_text(struct input_context *ctx,
+					const struct delimiter_class *dc,
+					const char *text, size_t length,
+					void (*partial_fn)(char *, void *),
+					void (*complete_fn)(void *),
+					void *arg)
+{
+  struct token_scanner s;
+  size_t start, end, piece;
+
+  init_token_scanner(&s, dc, text, length);
+  while (scanner_next(&s, &start, &end)) {
+    for (; start < end; start += piece) {
+      piece = end - start;
+      if (piece > ctx->buffer_size - 1) {
+	piece = ctx->buffer_size - 1;
+      }
+      if (dc->fold_case) {
+	fold_case_copy(ctx->buffer, text + start, piece);
+      } else {
+	memcpy(ctx->buffer, text + start, piece);
+      }
+      ctx->buffer[piece] = '\0';
+      partial_fn(ctx->buffer, arg);
+    }
+    complete_fn(arg);
+  }
+}
+
+/**
+ * Tokenize the input stream of the context and call the callback functions
+ * for each token.
  * The callback function is free to modify the passed token as long as the
  * function does not modify the passed token beyond its original length.
  * The passed token will be modified once the callback function goes out of
@@ -299,72 +774,469 @@ static inline int load_next_text(char *buffer, size_t buffer_size)
  * - " 12 34 \n" [Test Case (TC) 2]
  * - "12  3" [Test Case (TC) 3]
  *
- * @param delimiter the token delimiter
- * @param buffer the tokenizing buffer allocated by the caller
- * @param buffer_size the size of the tokenizing buffer
+ * @param ctx the context whose input stream and tokenizing buffer are used
+ * @param dc the token delimiter class
  * @param partial_fn is called to process a token that can be incomplete
  * @param complete_fn is called to indicate that one or more tokens passed to
  * partial_fn forms one whole token.
+ * @param arg is passed as is to the callback functions
  *
  * @return zero if the input stream is empty or non-zero otherwise.
  */
-static inline int tokenizer(const char *delimiter,
-			    char *buffer, size_t buffer_size,
-			    void (*partial_fn)(char *),
-			    void (*complete_fn)(void))
+static inline int tokenizer_class_r(struct input_context *ctx,
+				    const struct delimiter_class *dc,
+				    void (*partial_fn)(char *, void *),
+				    void (*complete_fn)(void *),
+				    void *arg)
 {
-  char *f;
-  int has_text;
+  char *buffer = ctx->buffer;
+  size_t length;
+  int token_exists = 0; /* Last word exists although it may or may not be
+			   truncated so that at least it makes sense to
+			   output \n. If no word exists, it is totally wrong
+			   to output \n. [TC 2] */
+  void *map;
+  size_t map_length;
+  const char *text = map_in_stream(ctx, &length, &map, &map_length);
 
-  has_text = load_next_text(buffer, buffer_size); // Read text from input stream
-  if (!has_text) { // Empty input
+  if (text != NULL) {
+    tokenize_mapped_text(ctx, dc, text, length, partial_fn, complete_fn, arg);
+    unmap_in_stream(ctx, map, map_length);
+    return 1;
+  }
+
+  length = load_next_text(ctx); // Read text from input stream
+  if (length == 0) { // Empty input
     return 0;
   }
-  
+
   do {
-    int token_exists = 0; /* Last word exists although it may or may not be
-			     truncated so that at least it makes sense to
-			     output \n. If no word exists, it is totally wrong
-			     to output \n. [TC 2] */
-    int not_truncated = 0; /* Last word in tokenizing buffer is not truncated
-			      [TC 1] */
-
-    if (strchr(delimiter, buffer[strlen(buffer) - 1]) != NULL) {
-      not_truncated = 1; /* Need to be obtained first because strtok() will
-			    mess the buffer up */
+    struct token_scanner s;
+    size_t start, end;
+
+    /* Fix truncated word at the end of the previous tokenizing buffer */
+    if (token_exists && is_delimiter(dc, buffer[0])) {
+      complete_fn(arg);
+      token_exists = 0;
     }
+    /* Finish fixing */
 
     /* Tokenize the text in the tokenizing buffer */
-    f = strtok(buffer, delimiter);
-    while (f != NULL) {
-      partial_fn(f);
+    init_token_scanner(&s, dc, buffer, length);
+    while (scanner_next(&s, &start, &end)) {
+      buffer[end] = '\0';
+      if (dc->fold_case) {
+	fold_case_copy(buffer + start, buffer + start, end - start);
+      }
+      partial_fn(buffer + start, arg);
 
-      f = strtok(NULL, delimiter);
-      if (f != NULL) { // Avoid truncating word at the end of tokenizing buffer
-	complete_fn();
+      if (end < length) { // Avoid truncating word at the end of buffer [TC 1]
+	complete_fn(arg);
+	token_exists = 0;
       } else {
-	if (not_truncated) {
-	  complete_fn();
-	} else {
-	  token_exists = 1;
-	}
+	token_exists = 1;
       }
     }
     /* End of tokenizing */
 
-    has_text = load_next_text(buffer, buffer_size); // Read next text
+    length = load_next_text(ctx); // Read next text
+  } while (length != 0); // A partial read still has text [TC 3]
+
+  if (token_exists) {
+    complete_fn(arg);
+  }
+
+  return 1;
+}
+
+/**
+ * Like tokenizer_class_r() but using the characters in the NULL-terminated
+ * delimiter as the delimiters without case folding.
+ */
+static inline int tokenizer_r(struct input_context *ctx,
+			      const char *delimiter,
+			      void (*partial_fn)(char *, void *),
+			      void (*complete_fn)(void *),
+			      void *arg)
+{
+  struct delimiter_class dc;
+
+  init_delimiter_class(&dc, delimiter, 0);
 
-    /* Fix truncated word at the end of tokenizing buffer */
-    if (token_exists && strchr(delimiter, buffer[0]) != NULL) {
-      complete_fn();
+  return tokenizer_class_r(ctx, &dc, partial_fn, complete_fn, arg);
+}
+
+static inline void append_carried_token(struct input_context *ctx,
+					const char *token, size_t length)
+{
+  if (ctx->carry_length + length > ctx->carry_size) {
+    size_t size = ctx->carry_size == 0 ? 64 : ctx->carry_size;
+    char *p;
+
+    while (size < ctx->carry_length + length) {
+      size *= 2;
     }
-    /* Finish fixing */
+    p = (char *) realloc(ctx->carry, size);
+    if (p == NULL) {
+      fatal_error("Insufficient memory");
+    }
+    ctx->carry = p;
+    ctx->carry_size = size;
+  }
+
+  memcpy(ctx->carry + ctx->carry_length, token, length);
+  ctx->carry_length += length;
+}
+
+/* Return the token as is unless it has to be case-folded, in which case it is
+ * folded into the folding buffer of the context, which is kept for reuse until
+ * destroy_input_context() is called. The token may be in the carry buffer.
+ */
+static inline const char *fold_token(struct input_context *ctx,
+				     const struct delimiter_class *dc,
+				     const char *token, size_t length)
+{
+  if (!dc->fold_case || !has_upper_case(token, length)) {
+    return token;
+  }
+
+  if (length > ctx->folded_size) {
+    size_t size = ctx->folded_size == 0 ? 64 : ctx->folded_size;
+    char *p;
+
+    while (size < length) {
+      size *= 2;
+    }
+    p = (char *) realloc(ctx->folded, size);
+    if (p == NULL) {
+      fatal_error("Insufficient memory");
+    }
+    ctx->folded = p;
+    ctx->folded_size = size;
+  }
+  fold_case_copy(ctx->folded, token, length);
+
+  return ctx->folded;
+}
+
+/**
+ * Call token_fn once for each token of the given read-only text, e.g., an
+ * input stream loaded using load_in_stream(), with the first byte of the
+ * token and the token length. The token is not NULL-terminated and is valid
+ * only during the call.
+ */
+static inline void tokenizer_text_span_r(struct input_context *ctx,
+					 const struct delimiter_class *dc,
+					 const char *text, size_t length,
+					 void (*token_fn)(const char *token,
+							  size_t length,
+							  void *arg),
+					 void *arg)
+{
+  struct token_scanner s;
+  size_t start, end;
+
+  init_token_scanner(&s, dc, text, length);
+  while (scanner_next(&s, &start, &end)) {
+    token_fn(fold_token(ctx, dc, text + start, end - start), end - start,
+	     arg);
+  }
+}
+
+/**
+ * Like map_in_stream() but an input stream that cannot be mapped is read
+ * whole into the carry buffer of the context, in which case map is set to
+ * NULL. Either way, the returned bytes are read-only and must be released
+ * using release_in_stream().
+ *
+ * @return the first unread byte, which may be NULL if length is set to zero
+ */
+static inline const char *load_in_stream(struct input_context *ctx,
+					 size_t *length,
+					 void **map, size_t *map_length)
+{
+  const char *data = map_in_stream(ctx, length, map, map_length);
+  size_t byte_read;
+
+  if (data != NULL) {
+    return data;
+  }
+
+  *map = NULL;
+  ctx->carry_length = 0;
+  while ((byte_read = load_next_text(ctx)) != 0) {
+    append_carried_token(ctx, ctx->buffer, byte_read);
+  }
+
+  *length = ctx->carry_length;
+  ctx->carry_length = 0;
+
+  return ctx->carry;
+}
+
+static inline void release_in_stream(struct input_context *ctx,
+				     void *map, size_t map_length)
+{
+  if (map != NULL) {
+    unmap_in_stream(ctx, map, map_length);
+  }
+}
+
+/**
+ * @return non-zero if the unread part of the input stream, which must not
+ * have been read using the stdio facility yet, is a regular file starting with
+ * the given magic bytes, or zero otherwise. Nothing is read from the stream.
+ */
+static inline int in_stream_has_magic(FILE *stream,
+				      const char *magic, size_t magic_size)
+{
+  struct stat st;
+  char bytes[16];
+  off_t pos;
+
+  assert(magic_size <= sizeof(bytes));
+
+  if (fstat(fileno(stream), &st) != 0 || !S_ISREG(st.st_mode)) {
+    return 0;
+  }
+
+  pos = ftello(stream);
+  if (pos < 0
+      || (pread(fileno(stream), bytes, magic_size, pos)
+	  != (ssize_t) magic_size)) {
+    return 0;
+  }
+
+  return memcmp(bytes, magic, magic_size) == 0;
+}
+
+/**
+ * Like tokenizer_class_r() but token_fn is called once for each complete
+ * token with the first byte of the token and the token length. The token is
+ * not NULL-terminated and is valid only during the call. It points into
+ * either the memory-mapped input stream or the tokenizing buffer. Only a
+ * token that straddles two consecutive loads of the tokenizing buffer is
+ * assembled in the carry buffer of the context, which is kept for reuse until
+ * destroy_input_context() is called, and a token of the mapping that must be
+ * case-folded is folded as fold_token() does.
+ *
+ * @return 0 if the input stream is empty or 1 otherwise
+ */
+static inline int tokenizer_class_span_r(struct input_context *ctx,
+					 const struct delimiter_class *dc,
+					 void (*token_fn)(const char *token,
+							  size_t length,
+							  void *arg),
+					 void *arg)
+{
+  char *buffer = ctx->buffer;
+  struct token_scanner s;
+  size_t length, start, end;
+  void *map;
+  size_t map_length;
+  const char *text = map_in_stream(ctx, &length, &map, &map_length);
+
+  if (text != NULL) {
+    tokenizer_text_span_r(ctx, dc, text, length, token_fn, arg);
+    unmap_in_stream(ctx, map, map_length);
+    return 1;
+  }
 
-  } while (has_text); // block_read is zero even for partial input [TC 3]
+  length = load_next_text(ctx); // Read text from input stream
+  if (length == 0) { // Empty input
+    return 0;
+  }
+
+  ctx->carry_length = 0;
+  do {
+    /* Complete the token carried over from the previous tokenizing buffer */
+    if (ctx->carry_length > 0 && is_delimiter(dc, buffer[0])) {
+      token_fn(ctx->carry, ctx->carry_length, arg);
+      ctx->carry_length = 0;
+    }
+
+    init_token_scanner(&s, dc, buffer, length);
+    while (scanner_next(&s, &start, &end)) {
+      if (dc->fold_case) {
+	fold_case_copy(buffer + start, buffer + start, end - start);
+      }
+      if (end == length) { // The token may continue in the next load
+	append_carried_token(ctx, buffer + start, end - start);
+      } else if (ctx->carry_length > 0) { // The rest of the carried token
+	append_carried_token(ctx, buffer + start, end - start);
+	token_fn(ctx->carry, ctx->carry_length, arg);
+	ctx->carry_length = 0;
+      } else {
+	token_fn(buffer + start, end - start, arg);
+      }
+    }
+
+    length = load_next_text(ctx); // Read next text
+  } while (length != 0); // A partial read still has text [TC 3]
+
+  if (ctx->carry_length > 0) {
+    token_fn(ctx->carry, ctx->carry_length, arg);
+    ctx->carry_length = 0;
+  }
 
   return 1;
 }
 
+/**
+ * Like tokenizer_class_span_r() but using the characters in the
+ * NULL-terminated delimiter as the delimiters without case folding.
+ */
+static inline int tokenizer_span_r(struct input_context *ctx,
+				   const char *delimiter,
+				   void (*token_fn)(const char *token,
+						    size_t length,
+						    void *arg),
+				   void *arg)
+{
+  struct delimiter_class dc;
+
+  init_delimiter_class(&dc, delimiter, 0);
+
+  return tokenizer_class_span_r(ctx, &dc, token_fn, arg);
+}
+
+/* The functions below are the global-based API: they work on in_stream and
+ * call callback functions that take no argument.
+ */
+
+struct tokenizer_fns {
+  void (*partial_fn)(char *);
+  void (*complete_fn)(void);
+  void (*token_fn)(const char *, size_t);
+};
+
+static inline void call_partial_fn(char *token, void *fns)
+{
+  ((struct tokenizer_fns *) fns)->partial_fn(token);
+}
+
+static inline void call_complete_fn(void *fns)
+{
+  ((struct tokenizer_fns *) fns)->complete_fn();
+}
+
+static inline void call_token_fn(const char *token, size_t length, void *fns)
+{
+  ((struct tokenizer_fns *) fns)->token_fn(token, length);
+}
+
+/**
+ * Like tokenizer_class_r() but using in_stream and the given tokenizing
+ * buffer.
+ */
+static inline int tokenizer_class(const struct delimiter_class *dc,
+				  char *buffer, size_t buffer_size,
+				  void (*partial_fn)(char *),
+				  void (*complete_fn)(void))
+{
+  struct input_context ctx;
+  struct tokenizer_fns fns;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+  fns.partial_fn = partial_fn;
+  fns.complete_fn = complete_fn;
+
+  return tokenizer_class_r(&ctx, dc, call_partial_fn, call_complete_fn, &fns);
+}
+
+/**
+ * Like tokenizer_class() but using the characters in the NULL-terminated
+ * delimiter as the delimiters without case folding.
+ */
+static inline int tokenizer(const char *delimiter,
+			    char *buffer, size_t buffer_size,
+			    void (*partial_fn)(char *),
+			    void (*complete_fn)(void))
+{
+  struct delimiter_class dc;
+
+  init_delimiter_class(&dc, delimiter, 0);
+
+  return tokenizer_class(&dc, buffer, buffer_size, partial_fn, complete_fn);
+}
+
+/**
+ * Like tokenizer_class_span_r() but using in_stream and the given tokenizing
+ * buffer.
+ */
+static inline int tokenizer_class_span(const struct delimiter_class *dc,
+				       char *buffer, size_t buffer_size,
+				       void (*token_fn)(const char *token,
+							size_t length))
+{
+  struct input_context ctx;
+  struct tokenizer_fns fns;
+  int result;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+  fns.token_fn = token_fn;
+
+  result = tokenizer_class_span_r(&ctx, dc, call_token_fn, &fns);
+  destroy_input_context(&ctx);
+
+  return result;
+}
+
+/**
+ * Like tokenizer_class_span() but using the characters in the NULL-terminated
+ * delimiter as the delimiters without case folding.
+ */
+static inline int tokenizer_span(const char *delimiter,
+				 char *buffer, size_t buffer_size,
+				 void (*token_fn)(const char *token,
+						  size_t length))
+{
+  struct delimiter_class dc;
+
+  init_delimiter_class(&dc, delimiter, 0);
+
+  return tokenizer_class_span(&dc, buffer, buffer_size, token_fn);
+}
+
+#ifndef NDEBUG
+/* The vectorized classification and case folding must agree with the scalar
+ * ones
+ */
+static inline void test_scan_delimiters(const char *delimiter)
+{
+  struct delimiter_class dc;
+  char text[64], copy[64], folded[64];
+  unsigned int i, j;
+
+  init_delimiter_class(&dc, delimiter, 0);
+
+  for (i = 0; i < 256; i += 64) {
+    uint64_t mask, expected = 0;
+    int has_upper = 0;
+
+    for (j = 0; j < 64; j++) {
+      text[j] = (char) (i + j);
+      copy[j] = text[j];
+      if (is_delimiter(&dc, text[j])) {
+	expected |= (uint64_t) 1 << j;
+      }
+      has_upper = has_upper || (text[j] >= 'A' && text[j] <= 'Z');
+    }
+
+    mask = scan_delimiters(&dc, text, 64);
+    assert(mask == expected);
+    assert(memcmp(text, copy, 64) == 0); // The text is never written
+
+    fold_case_copy(folded, text, 64);
+    for (j = 0; j < 64; j++) {
+      assert(folded[j] == (text[j] >= 'A' && text[j] <= 'Z'
+			   ? text[j] + ('a' - 'A') : text[j]));
+    }
+    assert(has_upper_case(text, 64) == has_upper);
+  }
+}
+#endif /* NDEBUG of test_scan_delimiters() */
+
 #ifdef __cplusplus
 }
 #endif
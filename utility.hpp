@@ -43,15 +43,6 @@
        itr != container.rend();					\
        itr++)
 
-#define MAIN_LIST_OF_FILE_START						\
-  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file); \
-  for (class_input_file_paths::iterator file_path = input_file_paths.begin(); \
-       file_path != input_file_paths.end(); file_path++)		\
-    {									\
-      open_in_stream(file_path->c_str());
-
-#define MAIN_LIST_OF_FILE_END }
-
 using namespace std;
 
 static string name_in_list_of_file;
@@ -0,0 +1,310 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_CONTAINER_HPP
+#define UTILITY_CONTAINER_HPP
+
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include "utility.h"
+
+using namespace std;
+
+/* A container holds many documents in one file so that a corpus does not
+ * need one file per document. Its layout, whose endianness follows that of
+ * the host machine, is as follows:
+ * +------------------------------------------------------------------+
+ * | Magic bytes \0CN\1                                               |
+ * +---------------------------------+-----------+--------------------+
+ * | NULL-terminated document name 1 | Payload_1 | Payload bytes 1    |
+ * +---------------------------------+-----------+--------------------+
+ * |                                ...                               |
+ * +---------------------------------+-----------+--------------------+
+ * | NULL-terminated document name N | Payload_N | Payload bytes N    |
+ * +---------------------------------+-----------+--------------------+
+ * | Offset of record 1 | ... | Offset of record N                    |
+ * +--------------------+-----+---------------------------------------+
+ * | Offset of the offset table | N | Magic bytes \0CN\1              |
+ * +------------------------------------------------------------------+
+ * Payload_i, the offsets and N are uint64_t (8 bytes) data. The trailing
+ * offset table lets a record be found without walking the ones before it
+ * while the records can still be streamed in order from the start.
+ */
+#define CONTAINER_MAGIC "\0CN\1"
+#define CONTAINER_MAGIC_SIZE 4
+
+struct container_footer {
+  uint64_t index_offset;
+  uint64_t record_count;
+  char magic[CONTAINER_MAGIC_SIZE];
+} __attribute__((packed));
+
+/* Appends records to a new container; a record is written at once */
+class class_container_writer
+{
+private:
+  FILE *out;
+  const char *out_name;
+  uint64_t offset;
+  vector<uint64_t> index;
+
+  inline void write(const void *data, size_t length, const char *what)
+  {
+    if (length != 0 && fwrite(data, length, 1, out) != 1) {
+      fatal_syserror("Cannot write %s to container %s", what, out_name);
+    }
+    offset += length;
+  }
+
+public:
+  class_container_writer(void) : out(NULL), out_name(NULL), offset(0)
+  {
+  }
+
+  inline void open(const char *path)
+  {
+    out = fopen(path, "w+"); // Readable for append_copy()
+    if (out == NULL) {
+      fatal_syserror("Cannot open output %s for writing", path);
+    }
+    out_name = path;
+    offset = 0;
+    index.clear();
+
+    write(CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE, "magic bytes");
+  }
+
+  inline void append(const char *name, const char *payload, size_t length)
+  {
+    uint64_t payload_length = length;
+
+    index.push_back(offset);
+    write(name, strlen(name) + 1, "document name");
+    write(&payload_length, sizeof(payload_length), "payload length");
+    write(payload, length, "payload");
+  }
+
+  /**
+   * Append a record having the payload of the i-th record appended so far,
+   * which is read back from the container using the given buffer.
+   */
+  inline void append_copy(const char *name, size_t i, vector<char> &buffer)
+  {
+    uint64_t end = i + 1 < index.size() ? index[i + 1] : offset;
+    uint64_t payload_length;
+
+    if (fflush(out) != 0) {
+      fatal_syserror("Cannot flush container %s", out_name);
+    }
+    buffer.resize(end - index[i]);
+    if (pread(fileno(out), &buffer[0], buffer.size(), index[i])
+	!= static_cast<ssize_t>(buffer.size())) {
+      fatal_syserror("Cannot read record #%lu back from container %s",
+		     static_cast<unsigned long>(i + 1), out_name);
+    }
+
+    const char *payload = &buffer[0] + strlen(&buffer[0]) + 1;
+    memcpy(&payload_length, payload, sizeof(payload_length));
+    append(name, payload + sizeof(payload_length), payload_length);
+  }
+
+  /* Write the offset table and close the container */
+  inline void close(void)
+  {
+    struct container_footer footer;
+
+    footer.index_offset = offset;
+    footer.record_count = index.size();
+    memcpy(footer.magic, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE);
+
+    write(index.empty() ? NULL : &index[0], index.size() * sizeof(index[0]),
+	  "offset table");
+    write(&footer, sizeof(footer), "footer");
+
+    close_local_out_stream(out, out_name);
+    out = NULL;
+  }
+};
+
+/* Gives the records of a container held in memory */
+class class_container_reader
+{
+private:
+  const char *data;
+  const char *name;
+  struct container_footer footer;
+  const char *index;
+
+public:
+  class_container_reader(void) : data(NULL), name(NULL), index(NULL)
+  {
+    footer.index_offset = 0;
+    footer.record_count = 0;
+  }
+
+  /**
+   * @return zero if the data does not start with the container magic bytes
+   * or non-zero otherwise, in which case the container must be well-formed
+   */
+  inline int open(const char *data, size_t length, const char *name)
+  {
+    if (length < CONTAINER_MAGIC_SIZE
+	|| memcmp(data, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE) != 0) {
+      return 0;
+    }
+
+    if (length < CONTAINER_MAGIC_SIZE + sizeof(footer)) {
+      fatal_error("Malformed container %s: no footer", name);
+    }
+    memcpy(&footer, data + length - sizeof(footer), sizeof(footer));
+    if (memcmp(footer.magic, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE) != 0
+	|| footer.index_offset < CONTAINER_MAGIC_SIZE
+	|| footer.index_offset > length - sizeof(footer)) {
+      fatal_error("Malformed container %s: corrupted footer", name);
+    }
+    uint64_t index_size = length - sizeof(footer) - footer.index_offset;
+    if (index_size % sizeof(uint64_t) != 0
+	|| index_size / sizeof(uint64_t) != footer.record_count) {
+      fatal_error("Malformed container %s: corrupted offset table", name);
+    }
+
+    this->data = data;
+    this->name = name;
+    index = data + footer.index_offset;
+
+    return 1;
+  }
+
+  inline size_t size(void) const
+  {
+    return footer.record_count;
+  }
+
+  /**
+   * Get the i-th record whose name is NULL-terminated. The payload points
+   * into the data given to open().
+   */
+  inline void get(size_t i, const char **doc_name,
+		  const char **payload, size_t *length) const
+  {
+    uint64_t offset, payload_length;
+    const char *end;
+
+    memcpy(&offset, index + i * sizeof(offset), sizeof(offset));
+    if (offset < CONTAINER_MAGIC_SIZE || offset >= footer.index_offset) {
+      fatal_error("Malformed container %s: corrupted offset #%lu",
+		  name, static_cast<unsigned long>(i + 1));
+    }
+
+    *doc_name = data + offset;
+    end = static_cast<const char *>(memchr(*doc_name, '\0',
+					   footer.index_offset - offset));
+    if (end == NULL
+	|| (footer.index_offset - static_cast<uint64_t>(end + 1 - data)
+	    < sizeof(payload_length))) {
+      fatal_error("Malformed container %s: corrupted record #%lu",
+		  name, static_cast<unsigned long>(i + 1));
+    }
+
+    memcpy(&payload_length, end + 1, sizeof(payload_length));
+    *payload = end + 1 + sizeof(payload_length);
+    if (payload_length > static_cast<uint64_t>(data + footer.index_offset
+					       - *payload)) {
+      fatal_error("Malformed container %s: corrupted record #%lu",
+		  name, static_cast<unsigned long>(i + 1));
+    }
+    *length = payload_length;
+  }
+};
+
+/**
+ * Call record_fn with every record of the container in the input stream of
+ * the context in order, or return zero if the input stream is not a container
+ * without reading anything from it. The document name is NULL-terminated and
+ * the payload is read-only; both are valid only during the call.
+ */
+static inline int parse_container_r(struct input_context *ctx,
+				    void (*record_fn)(const char *doc_name,
+						      const char *payload,
+						      size_t length,
+						      void *arg),
+				    void *arg)
+{
+  if (!in_stream_has_magic(ctx->stream, CONTAINER_MAGIC,
+			   CONTAINER_MAGIC_SIZE)) {
+    return 0;
+  }
+
+  void *map;
+  size_t map_length, length;
+  const char *data = load_in_stream(ctx, &length, &map, &map_length);
+  class_container_reader container;
+
+  container.open(data, length, ctx->stream_name);
+  for (size_t i = 0; i < container.size(); i++) {
+    const char *doc_name;
+    const char *payload;
+    size_t payload_length;
+
+    container.get(i, &doc_name, &payload, &payload_length);
+    record_fn(doc_name, payload, payload_length, arg);
+  }
+
+  release_in_stream(ctx, map, map_length);
+
+  return 1;
+}
+
+struct parse_container_global_fn {
+  void (*record_fn)(const char *doc_name, const char *payload,
+		    size_t length);
+};
+
+static inline void call_record_fn(const char *doc_name, const char *payload,
+				  size_t length, void *fn)
+{
+  static_cast<struct parse_container_global_fn *>(fn)->record_fn(doc_name,
+								   payload,
+								   length);
+}
+
+/**
+ * Like parse_container_r() but using in_stream and the given tokenizing
+ * buffer.
+ */
+static inline int parse_container(char *buffer, size_t buffer_size,
+				  void (*record_fn)(const char *doc_name,
+						    const char *payload,
+						    size_t length))
+{
+  struct parse_container_global_fn fn;
+  struct input_context ctx;
+  int result;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+  fn.record_fn = record_fn;
+
+  result = parse_container_r(&ctx, call_record_fn, &fn);
+
+  destroy_input_context(&ctx);
+
+  return result;
+}
+
+#endif /* UTILITY_CONTAINER_HPP */
@@ -0,0 +1,147 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_CONTENT_HASH_HPP
+#define UTILITY_CONTENT_HASH_HPP
+
+#include <cstdlib>
+#include <cstring>
+#include <stdint.h>
+#include "utility.h"
+
+using namespace std;
+
+/* XXH64 (see https://github.com/Cyan4973/xxHash) with seed 0, which hashes
+ * 32 bytes per round using four independent lanes so that hashing a document
+ * costs far less than tokenizing it.
+ */
+#define CONTENT_HASH_P1 11400714785074694791ULL
+#define CONTENT_HASH_P2 14029467366897019727ULL
+#define CONTENT_HASH_P3 1609587929392839161ULL
+#define CONTENT_HASH_P4 9650029242287828579ULL
+#define CONTENT_HASH_P5 2870177450012600261ULL
+
+static inline uint64_t content_hash_rotl(uint64_t x, unsigned int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t content_hash_round(uint64_t acc, uint64_t input)
+{
+  acc += input * CONTENT_HASH_P2;
+  acc = content_hash_rotl(acc, 31);
+  return acc * CONTENT_HASH_P1;
+}
+
+static inline uint64_t content_hash_merge(uint64_t acc, uint64_t lane)
+{
+  acc ^= content_hash_round(0, lane);
+  return acc * CONTENT_HASH_P1 + CONTENT_HASH_P4;
+}
+
+static inline uint64_t content_hash_value(const char *data, size_t length)
+{
+  const char *end = data + length;
+  uint64_t h, k;
+  uint32_t k32;
+
+  if (length >= 32) {
+    uint64_t v1 = CONTENT_HASH_P1 + CONTENT_HASH_P2;
+    uint64_t v2 = CONTENT_HASH_P2;
+    uint64_t v3 = 0;
+    uint64_t v4 = -CONTENT_HASH_P1;
+    uint64_t lanes[4];
+
+    for (; end - data >= 32; data += 32) {
+      memcpy(lanes, data, sizeof(lanes));
+      v1 = content_hash_round(v1, lanes[0]);
+      v2 = content_hash_round(v2, lanes[1]);
+      v3 = content_hash_round(v3, lanes[2]);
+      v4 = content_hash_round(v4, lanes[3]);
+    }
+
+    h = (content_hash_rotl(v1, 1) + content_hash_rotl(v2, 7)
+	 + content_hash_rotl(v3, 12) + content_hash_rotl(v4, 18));
+    h = content_hash_merge(h, v1);
+    h = content_hash_merge(h, v2);
+    h = content_hash_merge(h, v3);
+    h = content_hash_merge(h, v4);
+  } else {
+    h = CONTENT_HASH_P5;
+  }
+  h += length;
+
+  for (; end - data >= 8; data += 8) {
+    memcpy(&k, data, sizeof(k));
+    h ^= content_hash_round(0, k);
+    h = content_hash_rotl(h, 27) * CONTENT_HASH_P1 + CONTENT_HASH_P4;
+  }
+  if (end - data >= 4) {
+    memcpy(&k32, data, sizeof(k32));
+    h ^= k32 * CONTENT_HASH_P1;
+    h = content_hash_rotl(h, 23) * CONTENT_HASH_P2 + CONTENT_HASH_P3;
+    data += 4;
+  }
+  for (; data < end; data++) {
+    h ^= static_cast<unsigned char>(*data) * CONTENT_HASH_P5;
+    h = content_hash_rotl(h, 11) * CONTENT_HASH_P1;
+  }
+
+  h ^= h >> 33;
+  h *= CONTENT_HASH_P2;
+  h ^= h >> 29;
+  h *= CONTENT_HASH_P3;
+  h ^= h >> 32;
+
+  return h;
+}
+
+/* Two documents having the same key are taken to have the same bytes. With
+ * a 64-bit hash and the length, the chance that any two of a million
+ * documents of the same length are taken to be the same is below 10^-7.
+ */
+struct content_key {
+  uint64_t hash;
+  uint64_t length;
+
+  inline bool operator==(const struct content_key &other) const
+  {
+    return hash == other.hash && length == other.length;
+  }
+};
+
+static inline struct content_key content_key_of(const char *data,
+						size_t length)
+{
+  struct content_key key;
+
+  key.hash = content_hash_value(data, length);
+  key.length = length;
+
+  return key;
+}
+
+class content_key_hash
+{
+public:
+  inline size_t operator()(const struct content_key &key) const
+  {
+    return static_cast<size_t>(key.hash);
+  }
+};
+
+#endif /* UTILITY_CONTENT_HASH_HPP */
@@ -0,0 +1,377 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_DF_SKETCH_HPP
+#define UTILITY_DF_SKETCH_HPP
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cmath>
+#include <stdint.h>
+#include "utility.h"
+#include "utility_span.hpp"
+
+using namespace std;
+
+/* A count-min sketch of depth rows of width counters. A word adds its count
+ * to one counter in every row, and the smallest of its counters estimates its
+ * total count. The estimate is never less than the total count, and it
+ * exceeds the total count by more than epsilon() * total() with a
+ * probability of at most delta(). A word only raises those of its counters
+ * that are below its new estimate (conservative update), which keeps the
+ * bound while making the estimates closer.
+ */
+class class_count_min_sketch
+{
+private:
+  unsigned int width;
+  unsigned int depth;
+  vector<uint32_t> counters;
+  uint64_t total_count;
+
+  /* The rows take their columns from two halves of one mixed hash */
+  inline size_t column(uint64_t hash, unsigned int row) const
+  {
+    uint32_t a = static_cast<uint32_t>(hash);
+    uint32_t b = static_cast<uint32_t>(hash >> 32) | 1;
+
+    return row * static_cast<size_t>(width) + (a + row * b) % width;
+  }
+
+public:
+  class_count_min_sketch(void) : width(0), depth(0), total_count(0)
+  {
+  }
+
+  inline void init(unsigned int width, unsigned int depth)
+  {
+    this->width = width;
+    this->depth = depth;
+    counters.assign(static_cast<size_t>(width) * depth, 0);
+    total_count = 0;
+  }
+
+  static inline uint64_t hash(const char *word, size_t length)
+  {
+    uint64_t h = span_hash_value(word, length);
+
+    /* FNV-1a alone leaves the low bits poorly mixed for a modulo */
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+
+    return h;
+  }
+
+  inline uint32_t estimate(uint64_t hash) const
+  {
+    uint32_t min = counters[column(hash, 0)];
+
+    for (unsigned int r = 1; r < depth; r++) {
+      uint32_t c = counters[column(hash, r)];
+      if (c < min) {
+	min = c;
+      }
+    }
+
+    return min;
+  }
+
+  /* @return the new estimate of the word */
+  inline uint32_t add(uint64_t hash, uint32_t count)
+  {
+    uint32_t new_estimate = estimate(hash) + count;
+
+    for (unsigned int r = 0; r < depth; r++) {
+      uint32_t &c = counters[column(hash, r)];
+      if (c < new_estimate) {
+	c = new_estimate;
+      }
+    }
+    total_count += count;
+
+    return new_estimate;
+  }
+
+  inline uint64_t total(void) const
+  {
+    return total_count;
+  }
+
+  inline double epsilon(void) const
+  {
+    return M_E / width;
+  }
+
+  inline double delta(void) const
+  {
+    return exp(-static_cast<double>(depth));
+  }
+
+  inline size_t memory(void) const
+  {
+    return counters.size() * sizeof(counters[0]);
+  }
+};
+
+/* A table of at most capacity words having the largest estimates, kept in a
+ * min-heap so that, once the table is full, a word whose estimate exceeds the
+ * smallest one replaces the word having it (space-saving). Since estimates
+ * only grow, the smallest estimate in a full table never decreases, and so a
+ * word that is not in the table has an estimate of at most min_count().
+ */
+class class_heavy_hitters
+{
+private:
+  struct entry {
+    string word;
+    uint32_t count;
+    unsigned int heap_index;
+  };
+  vector<struct entry> entries;
+  vector<unsigned int> heap; /* indices to entries */
+  typedef unordered_map<class_span, unsigned int, span_hash> class_index;
+  class_index index;
+  unsigned int capacity;
+  uint64_t eviction_count;
+
+  inline bool less(unsigned int a, unsigned int b) const
+  {
+    return entries[heap[a]].count < entries[heap[b]].count;
+  }
+
+  inline void swap_nodes(unsigned int a, unsigned int b)
+  {
+    unsigned int e = heap[a];
+
+    heap[a] = heap[b];
+    heap[b] = e;
+    entries[heap[a]].heap_index = a;
+    entries[heap[b]].heap_index = b;
+  }
+
+  inline void sift_up(unsigned int i)
+  {
+    while (i > 0 && less(i, (i - 1) / 2)) {
+      swap_nodes(i, (i - 1) / 2);
+      i = (i - 1) / 2;
+    }
+  }
+
+  inline void sift_down(unsigned int i)
+  {
+    while (1) {
+      unsigned int min = i;
+      unsigned int l = 2 * i + 1;
+      unsigned int r = l + 1;
+
+      if (l < heap.size() && less(l, min)) {
+	min = l;
+      }
+      if (r < heap.size() && less(r, min)) {
+	min = r;
+      }
+      if (min == i) {
+	break;
+      }
+      swap_nodes(i, min);
+      i = min;
+    }
+  }
+
+public:
+  class_heavy_hitters(void) : capacity(0), eviction_count(0)
+  {
+  }
+
+  inline void init(unsigned int capacity)
+  {
+    this->capacity = capacity;
+    /* A word is keyed by the bytes of its entry, which must not move */
+    entries.clear();
+    entries.reserve(capacity);
+    heap.clear();
+    heap.reserve(capacity);
+    index.clear();
+    index.reserve(capacity);
+    eviction_count = 0;
+  }
+
+  /* Tell the table the latest estimate of the word */
+  inline void offer(const char *word, size_t length, uint32_t count)
+  {
+    class_index::iterator i = index.find(class_span(word, length));
+
+    if (i != index.end()) {
+      struct entry &e = entries[i->second];
+      e.count = count;
+      sift_down(e.heap_index);
+      return;
+    }
+
+    if (entries.size() < capacity) {
+      struct entry e;
+
+      entries.push_back(e);
+      entries.back().word.assign(word, length);
+      entries.back().count = count;
+      entries.back().heap_index = heap.size();
+      heap.push_back(entries.size() - 1);
+      index.insert(make_pair(class_span(entries.back().word.data(), length),
+			     entries.size() - 1));
+      sift_up(heap.size() - 1);
+      return;
+    }
+
+    if (capacity == 0 || count <= entries[heap[0]].count) {
+      return;
+    }
+
+    unsigned int evicted = heap[0];
+    struct entry &e = entries[evicted];
+    index.erase(class_span(e.word.data(), e.word.length()));
+    e.word.assign(word, length);
+    e.count = count;
+    index.insert(make_pair(class_span(e.word.data(), length), evicted));
+    sift_down(0);
+    eviction_count++;
+  }
+
+  inline unsigned int size(void) const
+  {
+    return entries.size();
+  }
+
+  inline unsigned int get_capacity(void) const
+  {
+    return capacity;
+  }
+
+  inline const string &word(unsigned int i) const
+  {
+    return entries[i].word;
+  }
+
+  inline uint32_t count(unsigned int i) const
+  {
+    return entries[i].count;
+  }
+
+  /* The largest estimate a word that is not in the table can have */
+  inline uint32_t min_count(void) const
+  {
+    return entries.size() < capacity || heap.empty()
+      ? 0 : entries[heap[0]].count;
+  }
+
+  inline uint64_t evictions(void) const
+  {
+    return eviction_count;
+  }
+
+  /* A rough cost of one word in the table excluding any word longer than
+   * the small-string buffer of std::string
+   */
+  static inline size_t memory_per_word(void)
+  {
+    return (sizeof(struct entry) + sizeof(unsigned int)
+	    + sizeof(class_index::value_type) + 3 * sizeof(void *));
+  }
+};
+
+/* Approximate document frequencies in about memory bytes: half is given to a
+ * count-min sketch of depth 4 and the other half to a table of the words
+ * having the largest estimated DFs, which are the only words that can be
+ * materialized.
+ */
+class class_df_sketch
+{
+private:
+  class_count_min_sketch sketch;
+  class_heavy_hitters table;
+
+public:
+  static const unsigned int depth = 4;
+
+  inline void init(size_t memory)
+  {
+    size_t width = memory / 2 / depth / sizeof(uint32_t);
+    size_t capacity = memory / 2 / class_heavy_hitters::memory_per_word();
+
+    if (width == 0 || capacity == 0) {
+      fatal_error("Too little memory for the DF sketch");
+    }
+    if (width > 0xFFFFFFFFUL) {
+      width = 0xFFFFFFFFUL;
+    }
+    if (capacity > 0xFFFFFFFFUL) {
+      capacity = 0xFFFFFFFFUL;
+    }
+
+    sketch.init(width, depth);
+    table.init(capacity);
+  }
+
+  /* Count one more document having the word */
+  inline void add(const char *word, size_t length)
+  {
+    table.offer(word, length,
+		sketch.add(class_count_min_sketch::hash(word, length), 1));
+  }
+
+  inline const class_count_min_sketch &get_sketch(void) const
+  {
+    return sketch;
+  }
+
+  inline const class_heavy_hitters &get_table(void) const
+  {
+    return table;
+  }
+
+  /* Report the error bounds of the estimates */
+  inline void report(FILE *out, uint32_t threshold) const
+  {
+    uint64_t error = static_cast<uint64_t>(ceil(sketch.epsilon()
+						* sketch.total()));
+
+    fprintf(out,
+	    "DF sketch: %u x %u counters (%lu bytes) over %llu word"
+	    " occurrences, and %u of at most %u words kept after %llu"
+	    " evictions\n"
+	    "DF sketch: every estimated DF exceeds the true DF by at most %llu"
+	    " with a probability of at least %f\n",
+	    depth, static_cast<unsigned int>(sketch.memory() / depth
+					     / sizeof(uint32_t)),
+	    static_cast<unsigned long>(sketch.memory()),
+	    static_cast<unsigned long long>(sketch.total()),
+	    table.size(), table.get_capacity(),
+	    static_cast<unsigned long long>(table.evictions()),
+	    static_cast<unsigned long long>(error), 1 - sketch.delta());
+    if (table.min_count() < threshold) {
+      fprintf(out, "DF sketch: no word having a DF of at least %u is lost\n",
+	      threshold);
+    } else {
+      fprintf(out,
+	      "DF sketch: a word having a DF of at least %u may be lost if its"
+	      " DF is at most %u\n", threshold, table.min_count());
+    }
+  }
+};
+
+#endif /* UTILITY_DF_SKETCH_HPP */
@@ -101,6 +101,7 @@
 #include <string>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include "utility.h"
 
 using namespace std;
@@ -262,42 +263,82 @@ public:
 typedef unordered_set<string> class_set_of_cats;
 typedef unordered_map<string, class_set_of_cats> class_doc_cat_list;
 
-static void (*active_doc_cat_fn)(const string &doc_nm, const string &cat_nm);
-static string doc_cat_line;
+/* The state of a load_doc_cat_file_r() call */
+struct doc_cat_loader {
+  void (*doc_cat_fn)(const string &doc_nm, const string &cat_nm, void *arg);
+  void *arg;
+  /* The strings keep their capacity so that no allocation takes place once
+   * they are long enough
+   */
+  string doc_name;
+  string cat_name;
+};
 
-static inline void doc_cat_list_partial_fn(char *line)
+static inline void doc_cat_list_token_fn(const char *line, size_t length,
+					 void *arg)
 {
-  doc_cat_line.append(line);
+  struct doc_cat_loader *loader = static_cast<struct doc_cat_loader *>(arg);
+  const char *space = static_cast<const char *>(memchr(line, ' ', length));
+
+  if (space == NULL) {
+    fatal_error("`%.*s' is a malformed DOC_CAT file entry",
+		static_cast<int>(length), line);
+  }
+
+  loader->doc_name.assign(line, space - line);
+  loader->cat_name.assign(space + 1, line + length - (space + 1));
+
+  loader->doc_cat_fn(loader->doc_name, loader->cat_name, loader->arg);
 }
 
-static inline void doc_cat_list_complete_fn(void)
+/**
+ * Read the DOC_CAT entries in the input stream of the context and call
+ * doc_cat_fn for each of them with arg as the last argument.
+ */
+static inline void load_doc_cat_file_r(struct input_context *ctx,
+				       void (*doc_cat_fn)(const string &doc_nm,
+							  const string &cat_nm,
+							  void *arg),
+				       void *arg)
 {
-  int pos = doc_cat_line.find(' ');
+  struct doc_cat_loader loader;
 
-  if (pos == -1) {
-    fatal_error("`%s' is a malformed DOC_CAT file entry",
-		doc_cat_line.c_str());
-  }
+  loader.doc_cat_fn = doc_cat_fn;
+  loader.arg = arg;
 
-  const string &doc_name = doc_cat_line.substr(0, pos);
-  const string &cat_name = doc_cat_line.substr(pos + 1);
+  tokenizer_span_r(ctx, "\n", doc_cat_list_token_fn, &loader);
+}
+
+struct doc_cat_global_fn {
+  void (*doc_cat_fn)(const string &doc_nm, const string &cat_nm);
+};
 
-  active_doc_cat_fn(doc_name, cat_name);
-  
-  doc_cat_line.clear();
+static inline void call_doc_cat_fn(const string &doc_nm, const string &cat_nm,
+				   void *fn)
+{
+  static_cast<struct doc_cat_global_fn *>(fn)->doc_cat_fn(doc_nm, cat_nm);
 }
 
+/**
+ * Like load_doc_cat_file_r() but opening the given file as in_stream and
+ * using the given tokenizing buffer.
+ */
 static inline void load_doc_cat_file(char *buffer, size_t buffer_size,
 				     const char *filename,
 				     void (*doc_cat_fn)(const string &doc_nm,
 							const string &cat_nm))
 {
-  active_doc_cat_fn = doc_cat_fn;
+  struct doc_cat_global_fn fn;
+  struct input_context ctx;
 
   open_in_stream(filename);
 
-  tokenizer("\n", buffer, buffer_size,
-	    doc_cat_list_partial_fn, doc_cat_list_complete_fn);
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+  fn.doc_cat_fn = doc_cat_fn;
+
+  load_doc_cat_file_r(&ctx, call_doc_cat_fn, &fn);
+
+  destroy_input_context(&ctx);
 }
 
 #endif /* UTILITY_DOC_CAT_LIST_HPP */
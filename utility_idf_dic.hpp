@@ -18,127 +18,699 @@
 #ifndef UTILITY_IDF_DIC_HPP
 #define UTILITY_IDF_DIC_HPP
 
-#include <unordered_map>
-#include <string>
-#include <list>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#include <sys/mman.h>
 #include "utility.h"
+#include "utility_span.hpp"
+#include "utility_vector.hpp"
+#include "utility_perfect_hash.hpp"
 
 using namespace std;
 
-typedef pair<unsigned int, double> class_idf_entry;
-typedef unordered_map<string, class_idf_entry> class_idf_list;
-static class_idf_list idf_list;
+/* An IDF_DIC comes in one of the following formats:
+ * 1. Version 1: the sparse vectors described in the usage of idf_dic.
+ * 2. Version 2: laid out to be used in place once memory-mapped as follows:
+ *    +----------------------------------------------------------------+
+ *    | Magic bytes \0ID\2 | Section count S | M | Word count N        |
+ *    +----------------------------------------------------------------+
+ *    | Section 1: id | reserved | offset | length                     |
+ *    |                              ...                               |
+ *    | Section S: id | reserved | offset | length                     |
+ *    +----------------------------------------------------------------+
+ *    | Section data, each starting at an offset that is a multiple of |
+ *    | 8 from the start of the file                                   |
+ *    +----------------------------------------------------------------+
+ *    S, id and reserved are uint32_t (4 bytes) data. M, N, offset and length
+ *    are uint64_t (8 bytes) data. The endianness follows that of the host
+ *    machine. A section whose id is unknown is skipped so that a section can
+ *    be added without a new version. The known sections, which are all
+ *    mandatory, are:
+ *    - IDF: N doubles (8 bytes) in which the i-th is the IDF of word i.
+ *    - DOC_COUNT: N uint32_t in which the i-th is the doc_count of word i.
+ *    - OFFSETS: N + 1 uint64_t in which the i-th is the offset of word i in
+ *      the WORDS section and the last is the length of the WORDS section.
+ *    - WORDS: the NULL-terminated words.
+ *    The following sections are optional:
+ *    - HASH_BUCKETS: N int32_t that are the buckets of a minimal perfect hash
+ *      of the words (see utility_perfect_hash.hpp).
+ *    - HASH_SLOTS: N struct idf_dic_hash_slot in which the i-th tells the
+ *      word in slot i of the minimal perfect hash and its fingerprint.
+ *    A hashed IDF_DIC, which idf_dic outputs when given -H, has no word.
+ *    Instead, it has the section FEATURE_HASHING holding a struct
+ *    idf_dic_feature_hashing, and N is 2^bits. Only the IDF and DOC_COUNT
+ *    sections are then mandatory, and the i-th entry of each is that of the
+ *    words whose feature_hash_value() has i as its low bits.
+ * In both formats, the offset of word i in a vector is i. The words are sorted
+ * by their bytes unless idf_dic was given -f to order them by descending
+ * doc_count.
+ */
+#define IDF_DIC_V2_MAGIC "\0ID\2"
+#define IDF_DIC_V2_MAGIC_SIZE 4
 
-static string utility_idf_dic_string;      
-static inline void utility_idf_dic_vector_size_fn(unsigned int size)
+enum idf_dic_section_id {
+  IDF_DIC_SECTION_IDF = 1,
+  IDF_DIC_SECTION_DOC_COUNT = 2,
+  IDF_DIC_SECTION_OFFSETS = 3,
+  IDF_DIC_SECTION_WORDS = 4,
+  IDF_DIC_SECTION_HASH_BUCKETS = 5,
+  IDF_DIC_SECTION_HASH_SLOTS = 6,
+  IDF_DIC_SECTION_FEATURE_HASHING = 7,
+};
+
+struct idf_dic_header {
+  char magic[IDF_DIC_V2_MAGIC_SIZE];
+  uint32_t section_count;
+  uint64_t M;
+  uint64_t size;
+} __attribute__((packed));
+
+struct idf_dic_section {
+  uint32_t id;
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t length;
+} __attribute__((packed));
+
+/* The fingerprint lets a word that is not in the IDF_DIC be rejected without
+ * comparing it with the word in the slot it hashes to
+ */
+struct idf_dic_hash_slot {
+  uint32_t word;
+  uint32_t fingerprint;
+};
+
+static inline uint32_t idf_dic_fingerprint(uint64_t hash)
 {
+  return static_cast<uint32_t>(hash >> 32);
 }
 
-static inline void utility_idf_dic_string_partial_fn(char *str)
+struct idf_dic_feature_hashing {
+  uint32_t bits;
+  uint32_t seed;
+};
+
+/* The largest number of bits of a hashed offset */
+#define FEATURE_HASHING_MAX_BITS 30
+
+/**
+ * Feature hashing maps a word to the offset given by the low bits of this
+ * value, and with signed hashing, the highest bit set negates the weight.
+ */
+static inline uint64_t feature_hash_value(uint32_t seed,
+					  const char *word, size_t length)
 {
-  utility_idf_dic_string.append(str);
+  return perfect_hash_value(seed, word, length);
 }
 
-static inline void utility_idf_dic_string_complete_fn(void)
+static inline unsigned int feature_hash_offset(uint64_t hash, uint32_t bits)
 {
+  return static_cast<unsigned int>(hash & ((1ULL << bits) - 1));
 }
 
-static inline void utility_idf_dic_offset_count_fn(unsigned int count)
+static inline int feature_hash_is_negative(uint64_t hash)
 {
+  return static_cast<int>(hash >> 63);
 }
 
-static unsigned int utility_idf_dic_M_has_been_taken = 0;
-static unsigned int utility_idf_dic_vector_position = 0;
-static inline void utility_idf_dic_double_fn(unsigned int index, double value)
+/* Build the minimal perfect hash of the given unique words */
+static inline void build_idf_dic_hash(const vector<class_span> &words,
+				      vector<int32_t> &buckets,
+				      vector<struct idf_dic_hash_slot> &slots)
 {
-  if (index != 0) {
-    return;
-  }
+  class_perfect_hash_builder builder;
+  struct perfect_hash_table t;
 
-  if (utility_idf_dic_M_has_been_taken) {
-    class_idf_entry &data = idf_list[utility_idf_dic_string];
-    data.first = utility_idf_dic_vector_position++;
-    data.second = value;
-  }
+  builder.build(words, &t);
 
-  utility_idf_dic_string.clear(); 
-}
+  buckets.assign(t.buckets, t.buckets + t.size);
+  slots.resize(t.size);
+  for (unsigned int s = 0; s < t.size; s++) {
+    const class_span &w = words[builder.word_in_slot(s)];
 
-static inline void utility_idf_dic_end_of_vector_fn(void)
-{
-  utility_idf_dic_M_has_been_taken = 1;
+    slots[s].word = builder.word_in_slot(s);
+    slots[s].fingerprint
+      = idf_dic_fingerprint(perfect_hash_value(0, w.data, w.length));
+  }
 }
 
-/* Map feature to offset and IDF */
-static inline void load_idf_dic_file(const char *filename)
+/* A loaded IDF_DIC of either format. A version 2 IDF_DIC that can be
+ * memory-mapped is used in place, while a version 1 one is parsed into arrays
+ * of the same layout. Either way, a word is found through the minimal perfect
+ * hash, which is built when loading an IDF_DIC that does not have one.
+ */
+class class_idf_dic
 {
-  open_in_stream(filename);
-
-  parse_vector(buffer, BUFFER_SIZE,
-	       utility_idf_dic_vector_size_fn,
-	       utility_idf_dic_string_partial_fn,
-	       utility_idf_dic_string_complete_fn,
-	       utility_idf_dic_offset_count_fn,
-	       utility_idf_dic_double_fn,
-	       utility_idf_dic_end_of_vector_fn);
-}
+private:
+  struct input_context ctx;
+  void *map;
+  size_t map_length;
 
-typedef pair<string, double> class_idf_entry_reversed;
-typedef unordered_map<unsigned int,
-		      class_idf_entry_reversed> class_idf_list_reversed;
-static class_idf_list_reversed idf_list_reversed;
+  uint64_t M_value;
+  size_t word_count;
+  const double *idfs;
+  const uint32_t *doc_counts;
+  const uint64_t *offsets;
+  const char *words;
+  const int32_t *hash_buckets;
+  const struct idf_dic_hash_slot *hash_slots;
+  struct idf_dic_feature_hashing hashing; /* bits is 0 if not hashed */
 
-static inline void utility_idf_dic_vector_size_reversed_fn(unsigned int size)
-{
-}
+  /* The minimal perfect hash built when the IDF_DIC does not have one */
+  vector<int32_t> built_buckets;
+  vector<struct idf_dic_hash_slot> built_slots;
 
-static inline void utility_idf_dic_string_partial_reversed_fn(char *str)
-{
-  utility_idf_dic_string.append(str);
-}
+  /* The arrays of a version 1 IDF_DIC */
+  vector<double> v1_idfs;
+  vector<uint32_t> v1_doc_counts;
+  vector<uint64_t> v1_offsets;
+  vector<char> v1_words;
+  unsigned int v1_record;
+  unsigned int v1_value_count;
 
-static inline void utility_idf_dic_string_complete_reversed_fn(void)
-{
-}
+  static void v1_size_fn(unsigned int size, void *arg)
+  {
+    class_idf_dic *self = static_cast<class_idf_dic *>(arg);
 
-static inline void utility_idf_dic_offset_count_reversed_fn(unsigned int count)
-{
-}
+    if (size != 2) {
+      fatal_error("%s is not an IDF_DIC", self->ctx.stream_name);
+    }
+  }
 
-static inline void utility_idf_dic_double_reversed_fn(unsigned int index,
-						      double value)
-{
-  if (index != 0) {
-    return;
+  static void v1_partial_fn(const char *str, void *arg)
+  {
+    class_idf_dic *self = static_cast<class_idf_dic *>(arg);
+
+    self->v1_words.insert(self->v1_words.end(), str, str + strlen(str));
   }
 
-  if (utility_idf_dic_M_has_been_taken) {
-    class_idf_entry_reversed &data
-      = idf_list_reversed[utility_idf_dic_vector_position++];
-    data.first = utility_idf_dic_string;
-    data.second = value;
+  static void v1_complete_fn(void *arg)
+  {
   }
 
-  utility_idf_dic_string.clear(); 
-}
+  static void v1_count_fn(unsigned int count, void *arg)
+  {
+    static_cast<class_idf_dic *>(arg)->v1_value_count = 0;
+  }
 
-static inline void utility_idf_dic_end_of_vector_reversed_fn(void)
-{
-  utility_idf_dic_M_has_been_taken = 1;
-}
+  static void v1_double_fn(unsigned int index, double value, void *arg)
+  {
+    class_idf_dic *self = static_cast<class_idf_dic *>(arg);
+
+    if (self->v1_record == 0) {
+      if (index == 0) {
+	self->M_value = static_cast<uint64_t>(value);
+	self->v1_value_count |= 1;
+      }
+    } else if (index == 0) {
+      self->v1_idfs.push_back(value);
+      self->v1_value_count |= 1;
+    } else if (index == 1) {
+      self->v1_doc_counts.push_back(static_cast<uint32_t>(value));
+      self->v1_value_count |= 2;
+    }
+  }
+
+  static void v1_end_fn(void *arg)
+  {
+    class_idf_dic *self = static_cast<class_idf_dic *>(arg);
+    const char *name = self->ctx.stream_name;
+    vector<char> &w = self->v1_words;
+    vector<uint64_t> &o = self->v1_offsets;
 
-/* Map offset to feature and IDF */
-static inline void load_idf_dic_file_reversed_mapping(const char *filename)
+    if (self->v1_record == 0) {
+      if (w.size() != 1 || w[0] != 'M' || self->v1_value_count != 1) {
+	fatal_error("Malformed IDF_DIC %s: no M", name);
+      }
+      w.clear();
+      self->v1_record++;
+      return;
+    }
+
+    if (self->v1_value_count != 3) {
+      fatal_error("Malformed IDF_DIC %s: record #%u lacks IDF or doc_count",
+		  name, self->v1_record + 1);
+    }
+
+    w.push_back('\0');
+    o.push_back(w.size());
+
+    self->v1_record++;
+  }
+
+  inline void load_v1(const char *data, size_t length)
+  {
+    static const struct parse_vector_fns fns = {
+      v1_size_fn,
+      v1_partial_fn,
+      v1_complete_fn,
+      v1_count_fn,
+      v1_double_fn,
+      v1_end_fn,
+    };
+
+    v1_record = 0;
+    v1_offsets.assign(1, 0);
+    parse_mapped_vector(data, length, &fns, this);
+    if (v1_record == 0) {
+      fatal_error("Malformed IDF_DIC %s: no M", ctx.stream_name);
+    }
+
+    word_count = v1_idfs.size();
+    idfs = v1_idfs.empty() ? NULL : &v1_idfs[0];
+    doc_counts = v1_doc_counts.empty() ? NULL : &v1_doc_counts[0];
+    offsets = &v1_offsets[0];
+    words = v1_words.empty() ? NULL : &v1_words[0];
+
+    build_hash();
+  }
+
+  /**
+   * @return the data of the section, or NULL if the section is optional and
+   * not found
+   */
+  inline const char *section(const char *data, size_t length, uint32_t id,
+			     size_t expected_length, int is_optional = 0)
+  {
+    struct idf_dic_header header;
+    struct idf_dic_section s;
+
+    memcpy(&header, data, sizeof(header));
+    for (uint32_t i = 0; i < header.section_count; i++) {
+      memcpy(&s, data + sizeof(header) + i * sizeof(s), sizeof(s));
+      if (s.id != id) {
+	continue;
+      }
+      if (s.offset % 8 != 0 || s.offset > length
+	  || s.length != expected_length || s.length > length - s.offset) {
+	fatal_error("Malformed IDF_DIC %s: corrupted section %u",
+		    ctx.stream_name, id);
+      }
+      return data + s.offset;
+    }
+
+    if (!is_optional) {
+      fatal_error("Malformed IDF_DIC %s: no section %u", ctx.stream_name, id);
+    }
+    return NULL;
+  }
+
+  inline void build_hash(void)
+  {
+    vector<class_span> spans(word_count);
+
+    for (size_t i = 0; i < word_count; i++) {
+      spans[i] = class_span(word(i), word_length(i));
+    }
+    build_idf_dic_hash(spans, built_buckets, built_slots);
+
+    hash_buckets = built_buckets.empty() ? NULL : &built_buckets[0];
+    hash_slots = built_slots.empty() ? NULL : &built_slots[0];
+  }
+
+  /* A corrupted hash may only make a lookup fail */
+  inline void check_hash(void)
+  {
+    for (size_t i = 0; i < word_count; i++) {
+      if (hash_slots[i].word >= word_count
+	  || (hash_buckets[i] < 0
+	      && static_cast<size_t>(-(hash_buckets[i] + 1)) >= word_count)) {
+	fatal_error("Malformed IDF_DIC %s: corrupted hash", ctx.stream_name);
+      }
+    }
+  }
+
+  inline void load_v2(const char *data, size_t length)
+  {
+    struct idf_dic_header header;
+
+    if (length < sizeof(header)) {
+      fatal_error("Malformed IDF_DIC %s: no header", ctx.stream_name);
+    }
+    memcpy(&header, data, sizeof(header));
+    if ((length - sizeof(header)) / sizeof(struct idf_dic_section)
+	< header.section_count
+	|| header.size > length / sizeof(double)) {
+      fatal_error("Malformed IDF_DIC %s: corrupted header", ctx.stream_name);
+    }
+    if (map != NULL) {
+      madvise(map, map_length, MADV_RANDOM);
+    }
+
+    M_value = header.M;
+    word_count = header.size;
+
+    const char *data_hashing
+      = section(data, length, IDF_DIC_SECTION_FEATURE_HASHING,
+		sizeof(hashing), 1);
+    if (data_hashing != NULL) {
+      memcpy(&hashing, data_hashing, sizeof(hashing));
+      if (hashing.bits == 0 || hashing.bits > FEATURE_HASHING_MAX_BITS
+	  || word_count != (1ULL << hashing.bits)) {
+	fatal_error("Malformed IDF_DIC %s: corrupted feature hashing",
+		    ctx.stream_name);
+      }
+    }
+
+    idfs = reinterpret_cast<const double *>
+      (section(data, length, IDF_DIC_SECTION_IDF,
+	       word_count * sizeof(double)));
+    doc_counts = reinterpret_cast<const uint32_t *>
+      (section(data, length, IDF_DIC_SECTION_DOC_COUNT,
+	       word_count * sizeof(uint32_t)));
+    if (is_hashed()) {
+      return;
+    }
+    offsets = reinterpret_cast<const uint64_t *>
+      (section(data, length, IDF_DIC_SECTION_OFFSETS,
+	       (word_count + 1) * sizeof(uint64_t)));
+
+    const char *data_words = NULL;
+    uint64_t words_length = offsets[word_count];
+    data_words = section(data, length, IDF_DIC_SECTION_WORDS, words_length);
+    if (offsets[0] != 0
+	|| (words_length != 0 && data_words[words_length - 1] != '\0')) {
+      fatal_error("Malformed IDF_DIC %s: corrupted words", ctx.stream_name);
+    }
+    for (size_t i = 0; i < word_count; i++) {
+      if (offsets[i + 1] <= offsets[i]
+	  || data_words[offsets[i + 1] - 1] != '\0') {
+	fatal_error("Malformed IDF_DIC %s: corrupted word #%lu",
+		    ctx.stream_name, static_cast<unsigned long>(i + 1));
+      }
+    }
+    words = data_words;
+
+    hash_buckets = reinterpret_cast<const int32_t *>
+      (section(data, length, IDF_DIC_SECTION_HASH_BUCKETS,
+	       word_count * sizeof(int32_t), 1));
+    hash_slots = reinterpret_cast<const struct idf_dic_hash_slot *>
+      (section(data, length, IDF_DIC_SECTION_HASH_SLOTS,
+	       word_count * sizeof(struct idf_dic_hash_slot), 1));
+    if (hash_buckets == NULL || hash_slots == NULL) {
+      build_hash();
+    } else {
+      check_hash();
+    }
+  }
+
+public:
+  class_idf_dic(void) : map(NULL), map_length(0), M_value(0), word_count(0),
+			idfs(NULL), doc_counts(NULL), offsets(NULL),
+			words(NULL), hash_buckets(NULL), hash_slots(NULL),
+			v1_record(0), v1_value_count(0)
+  {
+    init_input_context(&ctx, NULL, NULL, NULL, 0);
+    hashing.bits = 0;
+    hashing.seed = 0;
+  }
+
+  ~class_idf_dic(void)
+  {
+    close();
+  }
+
+  /**
+   * Load the IDF_DIC in the given file, reading it whole into the carry buffer
+   * of an internal context using the given tokenizing buffer when it cannot be
+   * memory-mapped.
+   */
+  inline void open(const char *path, char *buffer, size_t buffer_size)
+  {
+    size_t length;
+    const char *data;
+
+    close();
+
+    init_input_context(&ctx, NULL, NULL, buffer, buffer_size);
+    open_input_context(&ctx, path);
+    data = load_in_stream(&ctx, &length, &map, &map_length);
+    close_input_context(&ctx);
+
+    if (length >= IDF_DIC_V2_MAGIC_SIZE
+	&& memcmp(data, IDF_DIC_V2_MAGIC, IDF_DIC_V2_MAGIC_SIZE) == 0) {
+      load_v2(data, length);
+    } else {
+      load_v1(data, length);
+      release_in_stream(&ctx, map, map_length);
+      map = NULL;
+      destroy_input_context(&ctx);
+    }
+  }
+
+  inline void close(void)
+  {
+    release_in_stream(&ctx, map, map_length);
+    map = NULL;
+    destroy_input_context(&ctx);
+
+    M_value = 0;
+    word_count = 0;
+    idfs = NULL;
+    doc_counts = NULL;
+    offsets = NULL;
+    words = NULL;
+    hash_buckets = NULL;
+    hash_slots = NULL;
+    hashing.bits = 0;
+    hashing.seed = 0;
+    built_buckets.clear();
+    built_slots.clear();
+    v1_idfs.clear();
+    v1_doc_counts.clear();
+    v1_offsets.clear();
+    v1_words.clear();
+  }
+
+  /* The number of documents the IDF_DIC was built from */
+  inline unsigned long M(void) const
+  {
+    return M_value;
+  }
+
+  inline size_t size(void) const
+  {
+    return word_count;
+  }
+
+  /* A hashed IDF_DIC has no word, and every word is found in it */
+  inline int is_hashed(void) const
+  {
+    return hashing.bits != 0;
+  }
+
+  inline const struct idf_dic_feature_hashing &feature_hashing(void) const
+  {
+    return hashing;
+  }
+
+  /**
+   * @return non-zero if the word is found, in which case index is set to its
+   * index, or zero otherwise
+   */
+  inline int find(const char *word, size_t length, unsigned int *index) const
+  {
+    if (is_hashed()) {
+      *index = feature_hash_offset(feature_hash_value(hashing.seed,
+						      word, length),
+				   hashing.bits);
+      return 1;
+    }
+
+    if (word_count == 0) {
+      return 0;
+    }
+
+    uint64_t hash = perfect_hash_value(0, word, length);
+    int32_t bucket = hash_buckets[hash % word_count];
+    size_t slot;
+    if (bucket < 0) {
+      slot = -(bucket + 1);
+    } else {
+      slot = perfect_hash_value(bucket, word, length) % word_count;
+    }
+
+    const struct idf_dic_hash_slot &s = hash_slots[slot];
+    if (s.fingerprint != idf_dic_fingerprint(hash)
+	|| offsets[s.word + 1] - offsets[s.word] - 1 != length
+	|| memcmp(words + offsets[s.word], word, length) != 0) {
+      return 0;
+    }
+
+    *index = s.word;
+    return 1;
+  }
+
+  /* The NULL-terminated i-th word, which a hashed IDF_DIC does not have */
+  inline const char *word(unsigned int i) const
+  {
+    assert(!is_hashed());
+    return words + offsets[i];
+  }
+
+  inline size_t word_length(unsigned int i) const
+  {
+    assert(!is_hashed());
+    return offsets[i + 1] - offsets[i] - 1;
+  }
+
+  inline double idf(unsigned int i) const
+  {
+    return idfs[i];
+  }
+
+  inline unsigned int doc_count(unsigned int i) const
+  {
+    return doc_counts[i];
+  }
+};
+
+/* Collects the entries of an IDF_DIC in the order of their words to output
+ * them in version 2 format
+ */
+class class_idf_dic_writer
 {
-  open_in_stream(filename);
-
-  parse_vector(buffer, BUFFER_SIZE,
-	       utility_idf_dic_vector_size_reversed_fn,
-	       utility_idf_dic_string_partial_reversed_fn,
-	       utility_idf_dic_string_complete_reversed_fn,
-	       utility_idf_dic_offset_count_reversed_fn,
-	       utility_idf_dic_double_reversed_fn,
-	       utility_idf_dic_end_of_vector_reversed_fn);
-}
+private:
+  vector<double> idfs;
+  vector<uint32_t> doc_counts;
+  vector<uint64_t> offsets;
+  vector<char> words;
+
+  static inline void write(FILE *out, const void *data, size_t length,
+			   uint64_t *offset)
+  {
+    static const char padding[8] = {0};
+
+    if (length != 0 && fwrite(data, length, 1, out) != 1) {
+      fatal_syserror("Cannot write IDF_DIC to output stream");
+    }
+    *offset += length;
+
+    if (*offset % 8 != 0) {
+      size_t padding_length = 8 - *offset % 8;
+      if (fwrite(padding, padding_length, 1, out) != 1) {
+	fatal_syserror("Cannot write IDF_DIC to output stream");
+      }
+      *offset += padding_length;
+    }
+  }
+
+  struct section_data {
+    uint32_t id;
+    const void *data;
+    size_t length;
+  };
+
+  static inline void output_sections(FILE *out, unsigned long M, size_t size,
+				     const struct section_data *data,
+				     unsigned int count)
+  {
+    struct idf_dic_header header;
+    vector<struct idf_dic_section> sections(count);
+    uint64_t offset;
+
+    memcpy(header.magic, IDF_DIC_V2_MAGIC, IDF_DIC_V2_MAGIC_SIZE);
+    header.section_count = count;
+    header.M = M;
+    header.size = size;
+
+    offset = sizeof(header) + count * sizeof(sections[0]);
+    offset = (offset + 7) / 8 * 8;
+    for (unsigned int i = 0; i < count; i++) {
+      sections[i].id = data[i].id;
+      sections[i].reserved = 0;
+      sections[i].offset = offset;
+      sections[i].length = data[i].length;
+      offset += (sections[i].length + 7) / 8 * 8;
+    }
+
+    offset = 0;
+    if (fwrite(&header, sizeof(header), 1, out) != 1) {
+      fatal_syserror("Cannot write IDF_DIC to output stream");
+    }
+    offset += sizeof(header);
+    write(out, &sections[0], count * sizeof(sections[0]), &offset);
+    for (unsigned int i = 0; i < count; i++) {
+      write(out, data[i].data, data[i].length, &offset);
+    }
+  }
+
+public:
+  class_idf_dic_writer(void) : offsets(1, 0)
+  {
+  }
+
+  /* The words must be added in the order of their offsets */
+  inline void add(const char *word, size_t length, double idf,
+		  unsigned int doc_count)
+  {
+    idfs.push_back(idf);
+    doc_counts.push_back(doc_count);
+    words.insert(words.end(), word, word + length);
+    words.push_back('\0');
+    offsets.push_back(words.size());
+  }
+
+  inline void output(FILE *out, unsigned long M)
+  {
+    vector<class_span> spans(idfs.size());
+    vector<int32_t> buckets;
+    vector<struct idf_dic_hash_slot> slots;
+
+    for (size_t i = 0; i < spans.size(); i++) {
+      spans[i] = class_span(&words[offsets[i]],
+			    offsets[i + 1] - offsets[i] - 1);
+    }
+    build_idf_dic_hash(spans, buckets, slots);
+
+    const struct section_data sections[] = {
+      {IDF_DIC_SECTION_IDF, idfs.empty() ? NULL : &idfs[0],
+       idfs.size() * sizeof(idfs[0])},
+      {IDF_DIC_SECTION_DOC_COUNT, doc_counts.empty() ? NULL : &doc_counts[0],
+       doc_counts.size() * sizeof(doc_counts[0])},
+      {IDF_DIC_SECTION_OFFSETS, &offsets[0],
+       offsets.size() * sizeof(offsets[0])},
+      {IDF_DIC_SECTION_WORDS, words.empty() ? NULL : &words[0], words.size()},
+      {IDF_DIC_SECTION_HASH_BUCKETS, buckets.empty() ? NULL : &buckets[0],
+       buckets.size() * sizeof(buckets[0])},
+      {IDF_DIC_SECTION_HASH_SLOTS, slots.empty() ? NULL : &slots[0],
+       slots.size() * sizeof(slots[0])},
+    };
+
+    output_sections(out, M, idfs.size(), sections,
+		    sizeof(sections) / sizeof(sections[0]));
+  }
+
+  /**
+   * Output a hashed IDF_DIC of the given doc_count of every offset. An
+   * offset that no document has gets an IDF of zero so that the words hashed
+   * to it have no weight like a word not in a dictionary.
+   */
+  static inline void output_hashed(FILE *out, unsigned long M,
+				   const struct idf_dic_feature_hashing &h,
+				   const vector<uint32_t> &doc_counts)
+  {
+    vector<double> hashed_idfs(doc_counts.size());
+
+    for (size_t i = 0; i < doc_counts.size(); i++) {
+      hashed_idfs[i] = (doc_counts[i] == 0
+			? 0 : log(static_cast<double>(M) / doc_counts[i]));
+    }
+
+    const struct section_data sections[] = {
+      {IDF_DIC_SECTION_IDF, &hashed_idfs[0],
+       hashed_idfs.size() * sizeof(hashed_idfs[0])},
+      {IDF_DIC_SECTION_DOC_COUNT, &doc_counts[0],
+       doc_counts.size() * sizeof(doc_counts[0])},
+      {IDF_DIC_SECTION_FEATURE_HASHING, &h, sizeof(h)},
+    };
+
+    output_sections(out, M, doc_counts.size(), sections,
+		    sizeof(sections) / sizeof(sections[0]));
+  }
+};
 
 #endif /* UTILITY_IDF_DIC_HPP */
@@ -0,0 +1,299 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_PERFECT_HASH_HPP
+#define UTILITY_PERFECT_HASH_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <stdint.h>
+#include "utility.h"
+#include "utility_span.hpp"
+
+using namespace std;
+
+/* A minimal perfect hash table of a fixed set of N words built using the
+ * hash-and-displace technique: a word first falls into one of N buckets, and
+ * the bucket tells either the slot of its only word directly or the seed of
+ * a second hash that puts each of its words in a distinct slot. So, finding a
+ * word costs at most two hashes and one comparison, and no allocation.
+ * Before hashing, a word is rejected if no word in the set has its length or
+ * its first byte.
+ * The words are stored NULL-terminated in the order of their slots so that
+ * the word in slot i starts at offsets[i] and is offsets[i + 1] - offsets[i]
+ * - 1 bytes long.
+ * The table only holds pointers so that a table generated by perfect_hash_gen
+ * can live in constant data compiled into a processing unit.
+ */
+struct perfect_hash_table {
+  unsigned int size; /* the number of words, slots and buckets */
+  const int *buckets; /* a seed if > 0, or -(slot + 1) */
+  const unsigned int *offsets; /* size + 1 entries */
+  const char *words;
+  uint64_t length_filter; /* bit i for length i, bit 63 for length >= 63 */
+  uint64_t first_byte_filter[4];
+};
+
+static inline uint64_t perfect_hash_value(unsigned int seed,
+					  const char *word, size_t length)
+{
+  uint64_t h = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+
+  for (size_t i = 0; i < length; i++) {
+    h ^= static_cast<unsigned char>(word[i]);
+    h *= 1099511628211ULL;
+  }
+
+  /* FNV-1a alone leaves the low bits poorly mixed for a modulo */
+  h ^= h >> 33;
+  h *= 0xFF51AFD7ED558CCDULL;
+  h ^= h >> 33;
+
+  return h;
+}
+
+static inline unsigned int perfect_hash_length_bit(size_t length)
+{
+  return length < 63 ? length : 63;
+}
+
+/**
+ * @return non-zero if the word is in the table or zero otherwise
+ */
+static inline int perfect_hash_find(const struct perfect_hash_table *t,
+				    const char *word, size_t length)
+{
+  unsigned char first = length == 0 ? 0 : word[0];
+  unsigned int slot;
+  int bucket;
+
+  if (t->size == 0
+      || !((t->length_filter >> perfect_hash_length_bit(length)) & 1)
+      || !((t->first_byte_filter[first >> 6] >> (first & 63)) & 1)) {
+    return 0;
+  }
+
+  bucket = t->buckets[perfect_hash_value(0, word, length) % t->size];
+  if (bucket < 0) {
+    slot = -bucket - 1;
+  } else {
+    slot = perfect_hash_value(bucket, word, length) % t->size;
+  }
+
+  return (t->offsets[slot + 1] - t->offsets[slot] - 1 == length
+	  && memcmp(t->words + t->offsets[slot], word, length) == 0);
+}
+
+/* Builds a perfect_hash_table whose arrays it owns */
+class class_perfect_hash_builder
+{
+private:
+  vector<int> buckets;
+  vector<unsigned int> offsets;
+  vector<char> words;
+  vector<unsigned int> word_of_slot;
+
+  static bool larger_bucket(const vector<unsigned int> *a,
+			    const vector<unsigned int> *b)
+  {
+    return a->size() > b->size();
+  }
+
+public:
+  /**
+   * Build the table of the given words, which must be unique.
+   * The table stays valid until the next build or the builder is destroyed.
+   */
+  inline void build(const vector<class_span> &set, struct perfect_hash_table *t)
+  {
+    const unsigned int n = set.size();
+    vector<vector<unsigned int> > members(n);
+    vector<const vector<unsigned int> *> order(n);
+    vector<char> taken(n, 0);
+    vector<unsigned int> slots;
+
+    buckets.assign(n, 0);
+    word_of_slot.assign(n, 0);
+    memset(t, 0, sizeof(*t));
+
+    for (unsigned int i = 0; i < n; i++) {
+      members[perfect_hash_value(0, set[i].data, set[i].length) % n]
+	.push_back(i);
+      order[i] = &members[i];
+    }
+    stable_sort(order.begin(), order.end(), larger_bucket);
+
+    /* Place the big buckets first while most slots are still free */
+    unsigned int b = 0;
+    for (; b < n && order[b]->size() > 1; b++) {
+      const vector<unsigned int> &bucket = *order[b];
+      int seed = 1;
+
+      while (1) {
+	slots.clear();
+	for (unsigned int j = 0; j < bucket.size(); j++) {
+	  const class_span &w = set[bucket[j]];
+	  unsigned int s = perfect_hash_value(seed, w.data, w.length) % n;
+
+	  if (taken[s] || find(slots.begin(), slots.end(), s) != slots.end()) {
+	    break;
+	  }
+	  slots.push_back(s);
+	}
+	if (slots.size() == bucket.size()) {
+	  break;
+	}
+	if (seed == (1 << 24)) {
+	  fatal_error("Cannot build a perfect hash (duplicated word?)");
+	}
+	seed++;
+      }
+
+      for (unsigned int j = 0; j < bucket.size(); j++) {
+	taken[slots[j]] = 1;
+	word_of_slot[slots[j]] = bucket[j];
+      }
+      buckets[order[b] - &members[0]] = seed;
+    }
+
+    /* The buckets having only one word take the free slots directly */
+    unsigned int free_slot = 0;
+    for (; b < n && order[b]->size() == 1; b++) {
+      while (taken[free_slot]) {
+	free_slot++;
+      }
+      taken[free_slot] = 1;
+      word_of_slot[free_slot] = (*order[b])[0];
+      buckets[order[b] - &members[0]] = -static_cast<int>(free_slot) - 1;
+    }
+
+    offsets.clear();
+    words.clear();
+    for (unsigned int s = 0; s < n; s++) {
+      const class_span &w = set[word_of_slot[s]];
+      unsigned char first = w.length == 0 ? 0 : w.data[0];
+
+      offsets.push_back(words.size());
+      words.insert(words.end(), w.data, w.data + w.length);
+      words.push_back('\0');
+
+      t->length_filter |= 1ULL << perfect_hash_length_bit(w.length);
+      t->first_byte_filter[first >> 6] |= 1ULL << (first & 63);
+    }
+    offsets.push_back(words.size());
+
+    t->size = n;
+    t->buckets = n == 0 ? NULL : &buckets[0];
+    t->offsets = &offsets[0];
+    t->words = words.empty() ? NULL : &words[0];
+  }
+
+  /* The index in the set given to the last build of the word in the slot */
+  inline unsigned int word_in_slot(unsigned int slot) const
+  {
+    return word_of_slot[slot];
+  }
+};
+
+/**
+ * Output the table as C++ source code defining a constexpr
+ * perfect_hash_table of the given name.
+ */
+static inline void output_perfect_hash_table(FILE *out,
+					     const struct perfect_hash_table *t,
+					     const char *name)
+{
+  fprintf(out, "static constexpr int %s_buckets[] = {", name);
+  for (unsigned int i = 0; i < t->size; i++) {
+    fprintf(out, "%s%d", i % 8 == 0 ? "\n  " : " ", t->buckets[i]);
+    if (i + 1 < t->size) {
+      fputc(',', out);
+    }
+  }
+  fprintf(out, "%s};\n\n", t->size == 0 ? "0" : "\n");
+
+  fprintf(out, "static constexpr unsigned int %s_offsets[] = {", name);
+  for (unsigned int i = 0; i <= t->size; i++) {
+    fprintf(out, "%s%u", i % 8 == 0 ? "\n  " : " ", t->offsets[i]);
+    if (i < t->size) {
+      fputc(',', out);
+    }
+  }
+  fprintf(out, "\n};\n\n");
+
+  /* Every byte but an alphanumeric one is output as a three-digit octal
+   * escape so that neither a following digit nor a trigraph can change it
+   */
+  fprintf(out, "static constexpr char %s_words[] =", name);
+  for (unsigned int i = 0; i < t->size; i++) {
+    fprintf(out, "\n  \"");
+    for (unsigned int j = t->offsets[i]; j < t->offsets[i + 1]; j++) {
+      unsigned char c = t->words[j];
+      if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+	  || (c >= '0' && c <= '9')) {
+	fputc(c, out);
+      } else {
+	fprintf(out, "\\%03o", c);
+      }
+    }
+    fputc('"', out);
+  }
+  fprintf(out, "%s;\n\n", t->size == 0 ? " \"\"" : "");
+
+  fprintf(out,
+	  "static constexpr struct perfect_hash_table %s = {\n"
+	  "  %u,\n"
+	  "  %s_buckets,\n"
+	  "  %s_offsets,\n"
+	  "  %s_words,\n"
+	  "  0x%016llXULL,\n"
+	  "  {0x%016llXULL, 0x%016llXULL, 0x%016llXULL, 0x%016llXULL}\n"
+	  "};\n",
+	  name, t->size, name, name, name,
+	  static_cast<unsigned long long>(t->length_filter),
+	  static_cast<unsigned long long>(t->first_byte_filter[0]),
+	  static_cast<unsigned long long>(t->first_byte_filter[1]),
+	  static_cast<unsigned long long>(t->first_byte_filter[2]),
+	  static_cast<unsigned long long>(t->first_byte_filter[3]));
+}
+
+#ifndef NDEBUG
+/* Every word of the table must be found and no prefix of one may be */
+static inline void test_perfect_hash_table(const struct perfect_hash_table *t)
+{
+  for (unsigned int i = 0; i < t->size; i++) {
+    const char *w = t->words + t->offsets[i];
+    size_t length = t->offsets[i + 1] - t->offsets[i] - 1;
+
+    assert(perfect_hash_find(t, w, length));
+    if (length > 0) {
+      int prefix_is_word = 0;
+      for (unsigned int j = 0; j < t->size; j++) {
+	if (t->offsets[j + 1] - t->offsets[j] - 1 == length - 1
+	    && memcmp(t->words + t->offsets[j], w, length - 1) == 0) {
+	  prefix_is_word = 1;
+	}
+      }
+      assert(perfect_hash_find(t, w, length - 1) == prefix_is_word);
+    }
+  }
+}
+#endif /* NDEBUG of test_perfect_hash_table() */
+
+#endif /* UTILITY_PERFECT_HASH_HPP */
@@ -0,0 +1,306 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_PREFETCH_HPP
+#define UTILITY_PREFETCH_HPP
+
+#include <vector>
+#include <list>
+#include <string>
+#include <cerrno>
+#include <cstdlib>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "utility.h"
+#include "utility.hpp"
+
+using namespace std;
+
+/* The most threads opening files ahead no matter how wide the window is */
+#define PREFETCH_MAX_THREADS 16
+
+/* The bytes read at once by a thread reading a file into the page cache */
+#define PREFETCH_READ_SIZE (64 * 1024)
+
+/* The number of files opened ahead by default when another processor can run
+ * the opening threads. With only one processor, switching to them costs more
+ * than what they save unless the files are not yet in the page cache.
+ */
+#define PREFETCH_WINDOW 8
+
+static inline size_t default_prefetch_window(void)
+{
+  return sysconf(_SC_NPROCESSORS_ONLN) > 1 ? PREFETCH_WINDOW : 0;
+}
+
+/* The number of files opened ahead, which the option -r changes */
+static size_t prefetch_window = default_prefetch_window();
+
+/* Opens the files of a list ahead of the consumer, which gets them in the
+ * order of the list as file descriptors. A regular file is also read whole
+ * into the page cache, from which the consumer then maps or reads it, so that
+ * the latency of opening and reading a small file is hidden behind the work
+ * done on the previous ones. The data are not kept in buffers of their own:
+ * under memory pressure, the kernel may drop the pages of a file read ahead
+ * before the consumer gets to it, which then waits for the storage again.
+ * At most window files are being opened or waiting to be consumed at any
+ * time. With a window of zero, no thread is started, and the consumer opens
+ * every file itself. The opening threads do not report any error themselves;
+ * the consumer gets the errno of a file that cannot be opened.
+ */
+class class_file_prefetcher
+{
+private:
+  struct file {
+    const char *path;
+    int fd;
+    int error; /* errno of the failure, or zero */
+    int is_opened;
+  };
+
+  vector<struct file> files;
+  vector<pthread_t> threads;
+  pthread_mutex_t lock;
+  pthread_cond_t opened;
+  pthread_cond_t consumed;
+  size_t next_file; /* the next file to be opened */
+  size_t next_consumed; /* the files before it have been consumed */
+  size_t window;
+  int is_stopped;
+
+  inline void acquire(void)
+  {
+    if (pthread_mutex_lock(&lock) != 0) {
+      fatal_error("Cannot lock file prefetcher");
+    }
+  }
+
+  inline void release_lock(void)
+  {
+    if (pthread_mutex_unlock(&lock) != 0) {
+      fatal_error("Cannot unlock file prefetcher");
+    }
+  }
+
+  static void open_file(struct file *f, char *scratch)
+  {
+    struct stat st;
+    off_t offset = 0;
+    ssize_t byte_read;
+
+    f->fd = open(f->path, O_RDONLY);
+    if (f->fd == -1) {
+      f->error = errno;
+      return;
+    }
+
+    /* A failed read is left to the consumer to find again and report */
+    if (scratch == NULL || fstat(f->fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      return;
+    }
+    while ((byte_read = pread(f->fd, scratch, PREFETCH_READ_SIZE, offset)) > 0
+	   || (byte_read == -1 && errno == EINTR)) {
+      if (byte_read > 0) {
+	offset += byte_read;
+      }
+    }
+  }
+
+  static void *run_opener(void *arg)
+  {
+    class_file_prefetcher *self = static_cast<class_file_prefetcher *>(arg);
+    char *scratch = static_cast<char *>(malloc(PREFETCH_READ_SIZE));
+
+    self->acquire();
+    while (1) {
+      while (!self->is_stopped && self->next_file < self->files.size()
+	     && self->next_file >= self->next_consumed + self->window) {
+	pthread_cond_wait(&self->consumed, &self->lock);
+      }
+      if (self->is_stopped || self->next_file == self->files.size()) {
+	break;
+      }
+
+      struct file *f = &self->files[self->next_file++];
+      self->release_lock();
+
+      open_file(f, scratch);
+
+      self->acquire();
+      f->is_opened = 1;
+      pthread_cond_broadcast(&self->opened);
+    }
+    self->release_lock();
+    free(scratch);
+
+    return NULL;
+  }
+
+public:
+  class_file_prefetcher(void) : next_file(0), next_consumed(0), window(0),
+				is_stopped(0)
+  {
+    if (pthread_mutex_init(&lock, NULL) != 0
+	|| pthread_cond_init(&opened, NULL) != 0
+	|| pthread_cond_init(&consumed, NULL) != 0) {
+      fatal_error("Cannot initialize file prefetcher");
+    }
+  }
+
+  ~class_file_prefetcher(void)
+  {
+    stop();
+    pthread_cond_destroy(&consumed);
+    pthread_cond_destroy(&opened);
+    pthread_mutex_destroy(&lock);
+  }
+
+  /**
+   * Start opening the files at the given paths, which must stay valid until
+   * stop() returns, using min(window, PREFETCH_MAX_THREADS) threads.
+   */
+  inline void start(const list<string> &paths, size_t window)
+  {
+    struct file f;
+    unsigned int thread_count = (window < PREFETCH_MAX_THREADS
+				 ? window : PREFETCH_MAX_THREADS);
+
+    stop();
+
+    f.fd = -1;
+    f.error = 0;
+    f.is_opened = 0;
+    files.clear();
+    for (list<string>::const_iterator p = paths.begin(); p != paths.end();
+	 ++p) {
+      f.path = p->c_str();
+      files.push_back(f);
+    }
+
+    this->window = window;
+    next_file = 0;
+    next_consumed = 0;
+    is_stopped = 0;
+
+    threads.resize(thread_count);
+    for (unsigned int i = 0; i < thread_count; i++) {
+      if (pthread_create(&threads[i], NULL, run_opener, this) != 0) {
+	fatal_syserror("Cannot create prefetching thread %u", i);
+      }
+    }
+  }
+
+  /**
+   * Wait until the next file in the order of the list is opened, and hand its
+   * file descriptor, which the caller must close, over to the caller.
+   *
+   * @return the file descriptor, or -1 with errno set if the file cannot be
+   * opened
+   */
+  inline int next(void)
+  {
+    struct file *f = &files[next_consumed];
+
+    if (threads.empty()) {
+      next_consumed++;
+      return open(f->path, O_RDONLY);
+    }
+
+    acquire();
+    while (!f->is_opened) {
+      pthread_cond_wait(&opened, &lock);
+    }
+    next_consumed++;
+    pthread_cond_signal(&consumed); // One more file can be opened
+    release_lock();
+
+    if (f->fd == -1) {
+      errno = f->error;
+    }
+    return f->fd;
+  }
+
+  /* Stop opening ahead and close the files not yet consumed */
+  inline void stop(void)
+  {
+    if (threads.empty()) {
+      return;
+    }
+
+    acquire();
+    is_stopped = 1;
+    pthread_cond_broadcast(&consumed);
+    release_lock();
+
+    for (unsigned int i = 0; i < threads.size(); i++) {
+      if (pthread_join(threads[i], NULL) != 0) {
+	fatal_syserror("Cannot wait for prefetching thread %u", i);
+      }
+    }
+    threads.clear();
+
+    for (size_t i = next_consumed; i < files.size(); i++) {
+      if (files[i].fd != -1) {
+	close(files[i].fd);
+	files[i].fd = -1;
+      }
+    }
+  }
+};
+
+/* Like open_in_stream() but the input stream is the next file of the given
+ * prefetcher found at the given path
+ */
+static inline void open_prefetched_in_stream(class_file_prefetcher *prefetcher,
+					     const char *path)
+{
+  int fd;
+
+  recover_stdin();
+
+  fd = prefetcher->next();
+  if (fd == -1) {
+    fatal_syserror("Cannot open input %s for reading", path);
+  }
+  in_stream_name = path;
+  in_stream = fdopen(fd, "r");
+  if (in_stream == NULL) {
+    close(fd);
+    fatal_syserror("Cannot open input %s for reading", path);
+  }
+}
+
+/* The statements between MAIN_LIST_OF_FILE_START and MAIN_LIST_OF_FILE_END
+ * are run for every file in the list read from in_stream with file_path
+ * pointing to its path and in_stream opened to it. Up to prefetch_window
+ * files after the one in in_stream are opened ahead.
+ */
+#define MAIN_LIST_OF_FILE_START						\
+  {									\
+  class_file_prefetcher file_prefetcher;				\
+  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file); \
+  file_prefetcher.start(input_file_paths, prefetch_window);		\
+  for (class_input_file_paths::iterator file_path = input_file_paths.begin(); \
+       file_path != input_file_paths.end(); file_path++)		\
+    {									\
+      open_prefetched_in_stream(&file_prefetcher, file_path->c_str());
+
+#define MAIN_LIST_OF_FILE_END } file_prefetcher.stop(); }
+
+#endif /* UTILITY_PREFETCH_HPP */
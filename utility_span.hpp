@@ -0,0 +1,146 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_SPAN_HPP
+#define UTILITY_SPAN_HPP
+
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "utility.h"
+
+using namespace std;
+
+/* A token as given by tokenizer_span(), i.e., a sequence of bytes that is
+ * owned by someone else. Spans compare like std::string does so that a
+ * sorted list of spans is ordered like the corresponding sorted list of
+ * strings.
+ */
+class class_span
+{
+public:
+  const char *data;
+  size_t length;
+
+  class_span(void) : data(NULL), length(0)
+  {
+  }
+
+  class_span(const char *d, size_t l) : data(d), length(l)
+  {
+  }
+
+  inline bool operator==(const class_span &other) const
+  {
+    return (length == other.length
+	    && memcmp(data, other.data, length) == 0);
+  }
+
+  inline bool operator<(const class_span &other) const
+  {
+    size_t len = length < other.length ? length : other.length;
+    int result = memcmp(data, other.data, len);
+
+    if (result != 0) {
+      return result < 0;
+    }
+    return length < other.length;
+  }
+};
+
+/* FNV-1a */
+static inline size_t span_hash_value(const char *data, size_t length)
+{
+  uint64_t h = 14695981039346656037ULL;
+
+  for (size_t i = 0; i < length; i++) {
+    h ^= static_cast<unsigned char>(data[i]);
+    h *= 1099511628211ULL;
+  }
+
+  return static_cast<size_t>(h);
+}
+
+class span_hash
+{
+public:
+  inline size_t operator()(const class_span &s) const
+  {
+    return span_hash_value(s.data, s.length);
+  }
+};
+
+/* An arena to keep copies of tokens that must outlive the tokenizing buffer.
+ * The copies are NULL-terminated and are only released all at once.
+ */
+class class_string_pool
+{
+private:
+  static const size_t block_size = 64 * 1024;
+  vector<char *> blocks;
+  size_t used;
+  size_t capacity;
+
+public:
+  class_string_pool(void) : used(0), capacity(0)
+  {
+  }
+
+  ~class_string_pool()
+  {
+    clear();
+  }
+
+  /* Return a NULL-terminated copy of the given bytes */
+  inline const char *intern(const char *data, size_t length)
+  {
+    if (used + length + 1 > capacity) {
+      size_t size = length + 1 > block_size ? length + 1 : block_size;
+      char *block = static_cast<char *>(malloc(size));
+      if (block == NULL) {
+	fatal_error("Insufficient memory");
+      }
+      blocks.push_back(block);
+      used = 0;
+      capacity = size;
+    }
+
+    char *result = blocks.back() + used;
+    memcpy(result, data, length);
+    result[length] = '\0';
+    used += length + 1;
+
+    return result;
+  }
+
+  inline class_span intern(const class_span &s)
+  {
+    return class_span(intern(s.data, s.length), s.length);
+  }
+
+  inline void clear(void)
+  {
+    for (vector<char *>::iterator i = blocks.begin(); i != blocks.end(); ++i) {
+      free(*i);
+    }
+    blocks.clear();
+    used = 0;
+    capacity = 0;
+  }
+};
+
+#endif /* UTILITY_SPAN_HPP */
@@ -0,0 +1,95 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_STOP_LIST_HPP
+#define UTILITY_STOP_LIST_HPP
+
+#include <vector>
+#include <unordered_set>
+#include "utility.h"
+#include "utility_span.hpp"
+#include "utility_perfect_hash.hpp"
+#include "stop_list_table.h"
+
+using namespace std;
+
+/* The stop list compiled in from the make variable STOP_LIST, or the one
+ * loaded from a file of words separated by a newline character. Once set up,
+ * the stop list is only read, so that many threads can use it at once to
+ * filter their tokens while tokenizing.
+ */
+class class_stop_list
+{
+private:
+  const struct perfect_hash_table *table;
+  struct perfect_hash_table loaded_table;
+  class_perfect_hash_builder builder;
+  unordered_set<class_span, span_hash> unique_words;
+  vector<class_span> words;
+  class_string_pool word_pool;
+
+  static void word_fn(const char *f, size_t length, void *arg)
+  {
+    class_stop_list *self = static_cast<class_stop_list *>(arg);
+    class_span word(f, length);
+
+    if (self->unique_words.find(word) == self->unique_words.end()) {
+      word = self->word_pool.intern(word);
+      self->unique_words.insert(word);
+      self->words.push_back(word);
+    }
+  }
+
+public:
+  class_stop_list(void) : table(&builtin_stop_list)
+  {
+  }
+
+  /* Replace the stop list with the words in the file */
+  inline void load(const char *path, char *buffer, size_t buffer_size)
+  {
+    struct input_context ctx;
+
+    init_input_context(&ctx, NULL, NULL, buffer, buffer_size);
+    open_input_context(&ctx, path);
+    tokenizer_span_r(&ctx, "\n", word_fn, this);
+    close_input_context(&ctx);
+    destroy_input_context(&ctx);
+
+    builder.build(words, &loaded_table);
+    table = &loaded_table;
+
+    /* The builder keeps its own copy of the words */
+    unique_words.clear();
+    words.clear();
+    word_pool.clear();
+  }
+
+  inline int contains(const char *word, size_t length) const
+  {
+    return perfect_hash_find(table, word, length);
+  }
+
+#ifndef NDEBUG
+  inline void test(void) const
+  {
+    test_perfect_hash_table(table);
+  }
+#endif
+};
+
+#endif /* UTILITY_STOP_LIST_HPP */
@@ -0,0 +1,170 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_TERM_COUNTER_HPP
+#define UTILITY_TERM_COUNTER_HPP
+
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+#include "utility.h"
+#include "utility_span.hpp"
+
+using namespace std;
+
+/* Counts the occurrences of the terms of one document at a time. The term
+ * bytes are copied into an arena and the terms are found through an
+ * open-addressing table with linear probing whose slot refers to the term by
+ * its index. Resetting the counter for the next document only clears the
+ * slots that were used, keeping all memory for reuse, so that counting a
+ * document costs no allocation once the counter has seen a document as big.
+ * The terms are kept in the order of their first occurrence.
+ */
+class class_term_counter
+{
+public:
+  struct term {
+    size_t offset; /* of the NULL-terminated term bytes in the arena */
+    size_t length;
+    size_t hash;
+    unsigned int slot;
+    unsigned int count;
+  };
+
+private:
+  enum { no_term = ~0U };
+  vector<char> arena;
+  size_t arena_used;
+  vector<struct term> terms;
+  vector<unsigned int> slots; /* term indices; the size is a power of two */
+  size_t mask;
+
+  inline void grow_slots(void)
+  {
+    slots.assign(slots.size() * 2, no_term);
+    mask = slots.size() - 1;
+
+    for (unsigned int i = 0; i < terms.size(); i++) {
+      size_t s = terms[i].hash & mask;
+      while (slots[s] != no_term) {
+	s = (s + 1) & mask;
+      }
+      slots[s] = i;
+      terms[i].slot = s;
+    }
+  }
+
+public:
+  class_term_counter(void) : arena(4096), arena_used(0), slots(1024, no_term),
+			     mask(1023)
+  {
+  }
+
+  /**
+   * Count one more occurrence of the given term.
+   *
+   * @return the index of the term for get()
+   */
+  inline unsigned int add(const char *data, size_t length)
+  {
+    return add(data, length, span_hash_value(data, length), 1);
+  }
+
+  /**
+   * Count more occurrences of the given term whose span_hash_value() is
+   * already known (e.g., when merging the terms of another counter).
+   *
+   * @return the index of the term for get()
+   */
+  inline unsigned int add(const char *data, size_t length, size_t hash,
+			  unsigned int count)
+  {
+    size_t s = hash & mask;
+
+    while (slots[s] != no_term) {
+      struct term &t = terms[slots[s]];
+      if (t.hash == hash && t.length == length
+	  && memcmp(&arena[t.offset], data, length) == 0) {
+	t.count += count;
+	return slots[s];
+      }
+      s = (s + 1) & mask;
+    }
+
+    if (arena_used + length + 1 > arena.size()) {
+      size_t size = arena.size() * 2;
+      while (size < arena_used + length + 1) {
+	size *= 2;
+      }
+      arena.resize(size);
+    }
+
+    struct term t;
+    t.offset = arena_used;
+    t.length = length;
+    t.hash = hash;
+    t.slot = s;
+    t.count = count;
+    memcpy(&arena[arena_used], data, length);
+    arena[arena_used + length] = '\0';
+    arena_used += length + 1;
+
+    slots[s] = terms.size();
+    terms.push_back(t);
+
+    if (terms.size() * 2 > slots.size()) { // Keep the load factor <= 0.5
+      grow_slots();
+    }
+
+    return terms.size() - 1;
+  }
+
+  /* Count more occurrences of the term of the given index */
+  inline void add_count(unsigned int i, unsigned int count)
+  {
+    terms[i].count += count;
+  }
+
+  /* Forget all terms without releasing any memory */
+  inline void reset(void)
+  {
+    for (vector<struct term>::const_iterator i = terms.begin();
+	 i != terms.end(); ++i) {
+      slots[i->slot] = no_term;
+    }
+    terms.clear();
+    arena_used = 0;
+  }
+
+  inline size_t size(void) const
+  {
+    return terms.size();
+  }
+
+  /* The i-th distinct term in the order of first occurrence */
+  inline const struct term &get(size_t i) const
+  {
+    return terms[i];
+  }
+
+  inline const char *name(const struct term &t) const
+  {
+    return &arena[t.offset];
+  }
+};
+
+#endif /* UTILITY_TERM_COUNTER_HPP */
@@ -0,0 +1,253 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_TF_HPP
+#define UTILITY_TF_HPP
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "utility.h"
+
+using namespace std;
+
+/* A TF file comes in one of the following formats:
+ * 1. Text: one "WORD COUNT\n" line per word.
+ * 2. Binary: the magic bytes below followed by one record per word in which
+ *    a record is the word length as a varint, the word bytes, and the count
+ *    as a varint. A varint stores 7 bits per byte starting from the least
+ *    significant ones, and every byte but the last has its high bit set.
+ * A text TF file cannot start with the magic bytes since a word never
+ * contains the NULL character.
+ */
+#define BINARY_TF_MAGIC "\0TF\1"
+#define BINARY_TF_MAGIC_SIZE 4
+
+/* The longest varint of an unsigned long */
+#define VARINT_MAX_SIZE ((sizeof(unsigned long) * 8 + 6) / 7)
+
+static inline size_t encode_varint(char *out, unsigned long value)
+{
+  size_t i = 0;
+
+  while (value >= 0x80) {
+    out[i++] = static_cast<char>(value | 0x80);
+    value >>= 7;
+  }
+  out[i++] = static_cast<char>(value);
+
+  return i;
+}
+
+/**
+ * @return zero if the varint is truncated or too long, or non-zero otherwise
+ */
+static inline int decode_varint(const char **data, const char *end,
+				unsigned long *value)
+{
+  const char *p = *data;
+  unsigned long result = 0;
+  unsigned int shift = 0;
+
+  while (p < end && shift < sizeof(unsigned long) * 8) {
+    unsigned char c = static_cast<unsigned char>(*p++);
+    result |= static_cast<unsigned long>(c & 0x7F) << shift;
+    if ((c & 0x80) == 0) {
+      *data = p;
+      *value = result;
+      return 1;
+    }
+    shift += 7;
+  }
+
+  return 0;
+}
+
+static inline void append_binary_tf_record(vector<char> &out,
+					   const char *word, size_t length,
+					   unsigned long count)
+{
+  char varint[VARINT_MAX_SIZE];
+
+  out.insert(out.end(), varint, varint + encode_varint(varint, length));
+  out.insert(out.end(), word, word + length);
+  out.insert(out.end(), varint, varint + encode_varint(varint, count));
+}
+
+static inline void parse_binary_tf(const char *data, size_t length,
+				   const char *name,
+				   void (*tf_fn)(const char *word,
+						 size_t length,
+						 double count, void *arg),
+				   void *arg)
+{
+  const char *end = data + length;
+  unsigned int i = 0;
+
+  while (data < end) {
+    unsigned long word_length, count;
+
+    if (!decode_varint(&data, end, &word_length)
+	|| word_length > static_cast<unsigned long>(end - data)) {
+      fatal_error("Malformed binary TF %s: corrupted word #%u", name, i + 1);
+    }
+    const char *word = data;
+    data += word_length;
+
+    if (!decode_varint(&data, end, &count)) {
+      fatal_error("Malformed binary TF %s: corrupted count #%u", name, i + 1);
+    }
+
+    tf_fn(word, word_length, count, arg);
+    i++;
+  }
+}
+
+static inline void parse_text_tf(const char *data, size_t length,
+				 int need_count,
+				 void (*tf_fn)(const char *word,
+					       size_t length,
+					       double count, void *arg),
+				 void *arg)
+{
+  struct delimiter_class dc;
+  struct token_scanner s;
+  size_t start, end;
+
+  init_delimiter_class(&dc, "\n", 0);
+  init_token_scanner(&s, &dc, data, length);
+
+  while (scanner_next(&s, &start, &end)) {
+    const char *line = data + start;
+    size_t line_length = end - start;
+    const char *space
+      = static_cast<const char *>(memchr(line, ' ', line_length));
+
+    if (space == NULL) {
+      if (need_count) {
+	fatal_error("%.*s is a malformed input",
+		    static_cast<int>(line_length), line);
+      }
+      tf_fn(line, line_length, 0, arg);
+      continue;
+    }
+
+    double count = 0;
+    if (need_count) {
+      char number[64];
+      size_t number_length = line + line_length - (space + 1);
+
+      if (number_length >= sizeof(number)) {
+	number_length = sizeof(number) - 1;
+      }
+      memcpy(number, space + 1, number_length);
+      number[number_length] = '\0';
+      count = strtod(number, NULL);
+    }
+
+    tf_fn(line, space - line, count, arg);
+  }
+}
+
+/**
+ * Call tf_fn for every word in the TF data of either format with the word,
+ * which is not NULL-terminated, and its count, and with arg as the last
+ * argument. If need_count is zero, the count of a text TF line is not parsed
+ * and a line without any count is accepted; the given count is then zero.
+ * The name is used in error messages.
+ */
+static inline void parse_tf_data_r(const char *data, size_t length,
+				   const char *name, int need_count,
+				   void (*tf_fn)(const char *word,
+						 size_t length,
+						 double count, void *arg),
+				   void *arg)
+{
+  if (length >= BINARY_TF_MAGIC_SIZE
+      && memcmp(data, BINARY_TF_MAGIC, BINARY_TF_MAGIC_SIZE) == 0) {
+    parse_binary_tf(data + BINARY_TF_MAGIC_SIZE,
+		    length - BINARY_TF_MAGIC_SIZE, name, tf_fn, arg);
+  } else {
+    parse_text_tf(data, length, need_count, tf_fn, arg);
+  }
+}
+
+/**
+ * Like parse_tf_data_r() but on the TF file that is the input stream of the
+ * context. An input stream that cannot be memory-mapped is read into the
+ * carry buffer of the context.
+ */
+static inline void parse_tf_r(struct input_context *ctx, int need_count,
+			      void (*tf_fn)(const char *word, size_t length,
+					    double count, void *arg),
+			      void *arg)
+{
+  void *map;
+  size_t map_length, length;
+  const char *data = load_in_stream(ctx, &length, &map, &map_length);
+
+  parse_tf_data_r(data, length, ctx->stream_name, need_count, tf_fn, arg);
+
+  release_in_stream(ctx, map, map_length);
+}
+
+struct parse_tf_global_fn {
+  void (*tf_fn)(const char *word, size_t length, double count);
+};
+
+static inline void call_tf_fn(const char *word, size_t length, double count,
+			      void *fn)
+{
+  static_cast<struct parse_tf_global_fn *>(fn)->tf_fn(word, length, count);
+}
+
+/**
+ * Like parse_tf_r() but using in_stream and the given tokenizing buffer.
+ */
+static inline void parse_tf(char *buffer, size_t buffer_size, int need_count,
+			    void (*tf_fn)(const char *word, size_t length,
+					  double count))
+{
+  struct parse_tf_global_fn fn;
+  struct input_context ctx;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+  fn.tf_fn = tf_fn;
+
+  parse_tf_r(&ctx, need_count, call_tf_fn, &fn);
+
+  destroy_input_context(&ctx);
+}
+
+/**
+ * Like parse_tf_data_r() but calling tf_fn that takes no argument.
+ */
+static inline void parse_tf_data(const char *data, size_t length,
+				 const char *name,
+				 int need_count,
+				 void (*tf_fn)(const char *word, size_t length,
+					       double count))
+{
+  struct parse_tf_global_fn fn;
+
+  fn.tf_fn = tf_fn;
+
+  parse_tf_data_r(data, length, name, need_count, call_tf_fn, &fn);
+}
+
+#endif /* UTILITY_TF_HPP */
@@ -0,0 +1,225 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_THREAD_HPP
+#define UTILITY_THREAD_HPP
+
+/* The including unit must define THREADED before including utility.h so that
+ * the error messages carry the thread ID instead of the process ID.
+ */
+#ifndef THREADED
+#error "THREADED must be defined before including utility_thread.hpp"
+#endif
+
+#include <vector>
+#include <pthread.h>
+#include "utility.h"
+
+using namespace std;
+
+/* A fixed number of workers take the next job index from a shared counter
+ * until all jobs are taken, so that a slow job does not hold up the others.
+ */
+class class_worker_pool
+{
+private:
+  struct worker_args {
+    class_worker_pool *pool;
+    unsigned int worker;
+  };
+
+  size_t job_count;
+  size_t next_job;
+  void (*job_fn)(size_t job, unsigned int worker, void *arg);
+  void *job_arg;
+
+  static void *run_worker(void *args)
+  {
+    struct worker_args *a = static_cast<struct worker_args *>(args);
+    class_worker_pool *pool = a->pool;
+
+    while (1) {
+      size_t job = __sync_fetch_and_add(&pool->next_job, 1);
+      if (job >= pool->job_count) {
+	break;
+      }
+      pool->job_fn(job, a->worker, pool->job_arg);
+    }
+
+    return NULL;
+  }
+
+public:
+  /**
+   * Call job_fn(job, worker, arg) for every job in [0, job_count) using
+   * worker_count threads, and return once all calls have returned. The
+   * worker argument is in [0, worker_count) and identifies the calling thread
+   * so that job_fn can use per-worker data without locking. If worker_count
+   * is 1, job_fn is called in the calling thread in the order of the jobs.
+   */
+  inline void run(unsigned int worker_count, size_t job_count,
+		  void (*job_fn)(size_t job, unsigned int worker, void *arg),
+		  void *arg)
+  {
+    this->job_count = job_count;
+    this->next_job = 0;
+    this->job_fn = job_fn;
+    this->job_arg = arg;
+
+    if (worker_count <= 1) {
+      for (size_t job = 0; job < job_count; job++) {
+	job_fn(job, 0, arg);
+      }
+      return;
+    }
+
+    vector<pthread_t> threads(worker_count);
+    vector<struct worker_args> args(worker_count);
+
+    for (unsigned int i = 0; i < worker_count; i++) {
+      args[i].pool = this;
+      args[i].worker = i;
+      if (pthread_create(&threads[i], NULL, run_worker, &args[i]) != 0) {
+	fatal_syserror("Cannot create worker thread %u", i);
+      }
+    }
+
+    for (unsigned int i = 0; i < worker_count; i++) {
+      if (pthread_join(threads[i], NULL) != 0) {
+	fatal_syserror("Cannot wait for worker thread %u", i);
+      }
+    }
+  }
+};
+
+/* The results a reorder buffer keeps per worker, which is enough for a worker
+ * to go on while a slow job of another one holds up the consumption
+ */
+#define REORDER_WINDOW_PER_WORKER 16
+
+/* Lets workers that finish their jobs in any order hand over the results to
+ * be consumed in the order of the jobs. A result is kept until all results of
+ * the jobs before it have been consumed, and at most a window of results is
+ * kept: a worker that gets that far ahead of the consumption waits.
+ */
+class class_reorder_buffer
+{
+private:
+  pthread_mutex_t lock;
+  pthread_cond_t slot_freed;
+  vector<vector<char> > results; /* the result of a job is at job % size */
+  vector<char> ready;
+  size_t next_job;
+  int is_consuming; /* by the worker consuming next_job without the lock */
+  vector<char> consumed;
+  void (*consume_fn)(size_t job, const vector<char> &result, void *arg);
+  void *consume_arg;
+
+  inline void lock_buffer(void)
+  {
+    if (pthread_mutex_lock(&lock) != 0) {
+      fatal_error("Cannot lock reorder buffer");
+    }
+  }
+
+  inline void unlock_buffer(void)
+  {
+    if (pthread_mutex_unlock(&lock) != 0) {
+      fatal_error("Cannot unlock reorder buffer");
+    }
+  }
+
+public:
+  class_reorder_buffer(void)
+  {
+    if (pthread_mutex_init(&lock, NULL) != 0) {
+      fatal_error("Cannot initialize reorder buffer lock");
+    }
+    if (pthread_cond_init(&slot_freed, NULL) != 0) {
+      fatal_error("Cannot initialize reorder buffer condition");
+    }
+  }
+
+  ~class_reorder_buffer(void)
+  {
+    pthread_cond_destroy(&slot_freed);
+    pthread_mutex_destroy(&lock);
+  }
+
+  /**
+   * Expect the results of the jobs numbered from 0 to be consumed by
+   * consume_fn(job, result, arg), keeping at most window results. The calls
+   * to consume_fn are made without the lock held but never overlap.
+   */
+  inline void init(size_t window,
+		   void (*consume_fn)(size_t job, const vector<char> &result,
+				      void *arg),
+		   void *arg)
+  {
+    results.assign(window, vector<char>());
+    ready.assign(window, 0);
+    next_job = 0;
+    is_consuming = 0;
+    this->consume_fn = consume_fn;
+    consume_arg = arg;
+  }
+
+  /**
+   * Take the result of the job by swapping it with the vector of a consumed
+   * result, which has been cleared, after waiting for the job to be in the
+   * window. Then, unless another worker is already doing so, consume every
+   * result that is now next in order.
+   */
+  inline void submit(size_t job, vector<char> &result)
+  {
+    lock_buffer();
+
+    while (job >= next_job + results.size()) {
+      if (pthread_cond_wait(&slot_freed, &lock) != 0) {
+	fatal_error("Cannot wait for reorder buffer");
+      }
+    }
+
+    results[job % results.size()].swap(result);
+    ready[job % results.size()] = 1;
+
+    if (!is_consuming) {
+      is_consuming = 1;
+      while (ready[next_job % results.size()]) {
+	size_t consumed_job = next_job;
+
+	consumed.swap(results[consumed_job % results.size()]);
+	ready[consumed_job % results.size()] = 0;
+
+	unlock_buffer();
+	consume_fn(consumed_job, consumed, consume_arg);
+	consumed.clear();
+	lock_buffer();
+
+	next_job++;
+	if (pthread_cond_broadcast(&slot_freed) != 0) {
+	  fatal_error("Cannot signal reorder buffer");
+	}
+      }
+      is_consuming = 0;
+    }
+
+    unlock_buffer();
+  }
+};
+
+#endif /* UTILITY_THREAD_HPP */
@@ -106,27 +106,29 @@ static inline double dot_product_sparse_vector(const class_sparse_vector &a,
   return result;
 }
 
-static inline void load_next_chunk(char *buffer, size_t buffer_size,
+static inline void load_next_chunk(struct input_context *ctx,
 				   size_t *byte_read, size_t *offset)
 {
-  *byte_read = fread(buffer, 1, buffer_size - 1, in_stream);
-  buffer[buffer_size - 1] = '\0'; // Avoid buffer overflow
+  *byte_read = fread(ctx->buffer, 1, ctx->buffer_size - 1, ctx->stream);
+  ctx->buffer[ctx->buffer_size - 1] = '\0'; // Avoid buffer overflow
   *offset = 0;
 }
 
-static inline int read_string(char *buffer, size_t buffer_size,
+static inline int read_string(struct input_context *ctx,
 			      size_t *byte_read, size_t *offset,
-			      void (*string_partial_fn)(char *),
-			      unsigned int i)
+			      void (*string_partial_fn)(const char *, void *),
+			      void *arg, unsigned int i)
 {
+  char *buffer = ctx->buffer;
+
   if (*offset == *byte_read) {
 
-    if (*byte_read < buffer_size - 1) { // EOF
+    if (*byte_read < ctx->buffer_size - 1) { // EOF
       return 0;
     }
 
     // We land at the chunk boundary; load next one
-    load_next_chunk(buffer, buffer_size, byte_read, offset);
+    load_next_chunk(ctx, byte_read, offset);
 
     if (*byte_read == 0) { // EOF
       return 0;
@@ -138,12 +140,12 @@ static inline int read_string(char *buffer, size_t buffer_size,
     goto out;
   }
 
-  string_partial_fn(buffer + *offset);
+  string_partial_fn(buffer + *offset, arg);
   *offset += len;
 
   while (*offset == *byte_read) { // Truncated word
 
-    load_next_chunk(buffer, buffer_size, byte_read, offset);
+    load_next_chunk(ctx, byte_read, offset);
 
     if (*byte_read == 0) { // Empty stream
       fatal_error("Malformed record #%u: corrupted string", i + 1);
@@ -154,7 +156,7 @@ static inline int read_string(char *buffer, size_t buffer_size,
       break;
     }
 
-    string_partial_fn(buffer);
+    string_partial_fn(buffer, arg);
     *offset += len;    
   }
 
@@ -164,19 +166,21 @@ static inline int read_string(char *buffer, size_t buffer_size,
   return 1;
 }
 
-static inline void read_fixed_datum(char *buffer, size_t buffer_size,
+static inline void read_fixed_datum(struct input_context *ctx,
 				    size_t *byte_read, size_t *offset,
 				    unsigned int i, int j,
 				    void *result, size_t result_size)
 {
+  char *buffer = ctx->buffer;
+
   if (*offset == *byte_read) {
 
-    if (*byte_read < buffer_size - 1) { // EOF
+    if (*byte_read < ctx->buffer_size - 1) { // EOF
       fatal_error("Malformed record #%u: incomplete vector", i + 1);
     }
 
     // We land at the chunk boundary; load next one
-    load_next_chunk(buffer, buffer_size, byte_read, offset);
+    load_next_chunk(ctx, byte_read, offset);
 
     if (*byte_read == 0) { // EOF
       fatal_error("Malformed record #%u: incomplete vector", i + 1);
@@ -197,7 +201,7 @@ static inline void read_fixed_datum(char *buffer, size_t buffer_size,
     memcpy(ptr, buffer + *offset, len);
     ptr += len;
 
-    load_next_chunk(buffer, buffer_size, byte_read, offset);
+    load_next_chunk(ctx, byte_read, offset);
     if (*byte_read == 0) {
       fatal_error("Malformed record #%u: corrupted vector at element #%u",
 		  i + 1, j + 1);
@@ -205,25 +209,153 @@ static inline void read_fixed_datum(char *buffer, size_t buffer_size,
   }
 }
 
-static inline void parse_vector(char *buffer, size_t buffer_size,
-				void (*vector_size_fn)(unsigned int size),
-				void (*string_partial_fn)(char *str),
-				void (*string_complete_fn)(void),
-				void (*offset_count_fn)(unsigned int count),
-				void (*double_fn)(unsigned int index,
-						  double value),
-				void (*end_of_vector_fn)(void))
+/* The callback functions of parse_vector_r() */
+struct parse_vector_fns {
+  void (*vector_size_fn)(unsigned int size, void *arg);
+  void (*string_partial_fn)(const char *str, void *arg);
+  void (*string_complete_fn)(void *arg);
+  void (*offset_count_fn)(unsigned int count, void *arg);
+  void (*double_fn)(unsigned int index, double value, void *arg);
+  void (*end_of_vector_fn)(void *arg);
+};
+
+/* Every string is passed in place since it is NULL-terminated in the input
+ * stream itself, and every sparse vector entry is read in place.
+ */
+static inline void parse_mapped_vector(const char *data, size_t length,
+				       const struct parse_vector_fns *fns,
+				       void *arg)
+{
+  unsigned int count;
+  size_t offset = sizeof(count);
+
+  if (length < sizeof(count)) {
+    fatal_error("Malformed input: cannot read record count");
+  }
+  memcpy(&count, data, sizeof(count));
+  fns->vector_size_fn(count, arg);
+
+  unsigned int i = 0;
+  while (offset < length) {
+    const char *end = (const char *) memchr(data + offset, '\0',
+					    length - offset);
+    if (end == NULL) {
+      fatal_error("Malformed record #%u: corrupted string", i + 1);
+    }
+    if (end != data + offset) { // Empty string is fine
+      fns->string_partial_fn(data + offset, arg);
+    }
+    offset = end - data + 1;
+
+    fns->string_complete_fn(arg);
+
+    if (length - offset < sizeof(count)) {
+      fatal_error("Malformed record #%u: incomplete vector", i + 1);
+    }
+    memcpy(&count, data + offset, sizeof(count));
+    offset += sizeof(count);
+    fns->offset_count_fn(count, arg);
+
+    const struct sparse_vector_entry *e
+      = (const struct sparse_vector_entry *) (data + offset);
+    size_t available = (length - offset) / sizeof(*e);
+    if (available < count) {
+      if ((length - offset) % sizeof(*e) == 0) {
+	fatal_error("Malformed record #%u: incomplete vector", i + 1);
+      }
+      fatal_error("Malformed record #%u: corrupted vector at element #%u",
+		  i + 1, (unsigned int) available + 1);
+    }
+
+    for (unsigned int j = 0; j < count; j++) {
+      fns->double_fn(e[j].offset, e[j].value, arg);
+    }
+    offset += count * sizeof(*e);
+
+    fns->end_of_vector_fn(arg);
+
+    i++;
+  }
+}
+
+/**
+ * Call record_fn with the NULL-terminated name, the entry count and the
+ * entries, which may be unaligned, of every record of the mapped sparse
+ * vectors without reading any entry, so that indexing the records costs the
+ * same however long the vectors are.
+ * @return the vector size in the header
+ */
+static inline unsigned int index_mapped_vector(const char *data, size_t length,
+					       void (*record_fn)(const char *name,
+								 unsigned int count,
+								 const char *entries,
+								 void *arg),
+					       void *arg)
+{
+  unsigned int size, count;
+  size_t offset = sizeof(size);
+
+  if (length < sizeof(size)) {
+    fatal_error("Malformed input: cannot read record count");
+  }
+  memcpy(&size, data, sizeof(size));
+
+  unsigned int i = 0;
+  while (offset < length) {
+    const char *name = data + offset;
+    const char *end = (const char *) memchr(name, '\0', length - offset);
+    if (end == NULL) {
+      fatal_error("Malformed record #%u: corrupted string", i + 1);
+    }
+    offset = end - data + 1;
+
+    if (length - offset < sizeof(count)) {
+      fatal_error("Malformed record #%u: incomplete vector", i + 1);
+    }
+    memcpy(&count, data + offset, sizeof(count));
+    offset += sizeof(count);
+
+    if ((length - offset) / sizeof(struct sparse_vector_entry) < count) {
+      fatal_error("Malformed record #%u: incomplete vector", i + 1);
+    }
+    record_fn(name, count, data + offset, arg);
+    offset += count * sizeof(struct sparse_vector_entry);
+
+    i++;
+  }
+
+  return size;
+}
+
+/**
+ * Parse the sparse vectors in the input stream of the context using the
+ * tokenizing buffer of the context when the input stream cannot be
+ * memory-mapped. Every callback function is given arg as its last argument.
+ */
+static inline void parse_vector_r(struct input_context *ctx,
+				  const struct parse_vector_fns *fns,
+				  void *arg)
 {
+  void *map;
+  size_t map_length, length;
+  const char *data = map_in_stream(ctx, &length, &map, &map_length);
+
+  if (data != NULL) {
+    parse_mapped_vector(data, length, fns, arg);
+    unmap_in_stream(ctx, map, map_length);
+    return;
+  }
+
   size_t block_read;
   unsigned int count;
-  block_read = fread(&count, sizeof(count), 1, in_stream);
+  block_read = fread(&count, sizeof(count), 1, ctx->stream);
   if (block_read == 0) {
     fatal_error("Malformed input: cannot read record count");
   }
-  vector_size_fn(count);
+  fns->vector_size_fn(count, arg);
 
   size_t offset = 0;
-  load_next_chunk(buffer, buffer_size, &block_read, &offset);
+  load_next_chunk(ctx, &block_read, &offset);
 
   if (block_read == 0) { // Empty stream
     return;
@@ -231,31 +363,104 @@ static inline void parse_vector(char *buffer, size_t buffer_size,
 
   unsigned int i = 0;
   while (1) {
-    if (read_string(buffer, buffer_size,
-		    &block_read, &offset,
-		    string_partial_fn, i) == 0) { // No more record
+    if (read_string(ctx, &block_read, &offset,
+		    fns->string_partial_fn, arg, i) == 0) { // No more record
       break;
     }
 
-    string_complete_fn();
+    fns->string_complete_fn(arg);
 
-    read_fixed_datum(buffer, buffer_size, &block_read, &offset, i, -1,
+    read_fixed_datum(ctx, &block_read, &offset, i, -1,
 		     &count, sizeof(count));
-    offset_count_fn(count);
+    fns->offset_count_fn(count, arg);
 
     unsigned int j = 0;
     struct sparse_vector_entry e;
     while (j < count) {
-      read_fixed_datum(buffer, buffer_size, &block_read, &offset, i, j,
-		       &e, sizeof(e));
-      double_fn(e.offset, e.value);
+      read_fixed_datum(ctx, &block_read, &offset, i, j, &e, sizeof(e));
+      fns->double_fn(e.offset, e.value, arg);
       j++;
     }
 
-    end_of_vector_fn();
+    fns->end_of_vector_fn(arg);
 
     i++;
   }
 }
 
+/* The callback functions of parse_vector() */
+struct parse_vector_global_fns {
+  void (*vector_size_fn)(unsigned int size);
+  void (*string_partial_fn)(const char *str);
+  void (*string_complete_fn)(void);
+  void (*offset_count_fn)(unsigned int count);
+  void (*double_fn)(unsigned int index, double value);
+  void (*end_of_vector_fn)(void);
+};
+
+static inline void call_vector_size_fn(unsigned int size, void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->vector_size_fn(size);
+}
+
+static inline void call_string_partial_fn(const char *str, void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->string_partial_fn(str);
+}
+
+static inline void call_string_complete_fn(void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->string_complete_fn();
+}
+
+static inline void call_offset_count_fn(unsigned int count, void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->offset_count_fn(count);
+}
+
+static inline void call_double_fn(unsigned int index, double value, void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->double_fn(index, value);
+}
+
+static inline void call_end_of_vector_fn(void *fns)
+{
+  static_cast<struct parse_vector_global_fns *>(fns)->end_of_vector_fn();
+}
+
+/**
+ * Like parse_vector_r() but using in_stream and the given tokenizing buffer.
+ */
+static inline void parse_vector(char *buffer, size_t buffer_size,
+				void (*vector_size_fn)(unsigned int size),
+				void (*string_partial_fn)(const char *str),
+				void (*string_complete_fn)(void),
+				void (*offset_count_fn)(unsigned int count),
+				void (*double_fn)(unsigned int index,
+						  double value),
+				void (*end_of_vector_fn)(void))
+{
+  static const struct parse_vector_fns fns = {
+    call_vector_size_fn,
+    call_string_partial_fn,
+    call_string_complete_fn,
+    call_offset_count_fn,
+    call_double_fn,
+    call_end_of_vector_fn,
+  };
+  struct parse_vector_global_fns global_fns = {
+    vector_size_fn,
+    string_partial_fn,
+    string_complete_fn,
+    offset_count_fn,
+    double_fn,
+    end_of_vector_fn,
+  };
+  struct input_context ctx;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, buffer_size);
+
+  parse_vector_r(&ctx, &fns, &global_fns);
+}
+
 #endif /* UTILITY_VECTOR_HPP */
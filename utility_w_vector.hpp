@@ -0,0 +1,320 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#ifndef UTILITY_W_VECTOR_HPP
+#define UTILITY_W_VECTOR_HPP
+
+#include <vector>
+#include <cstring>
+#include <cmath>
+#include <stdint.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "utility.h"
+#include "utility_vector.hpp"
+#include "utility_idf_dic.hpp"
+
+using namespace std;
+
+/* TF'(i, d) = 1 + ln(TF(i, d)) is looked up for the small counts that most
+ * words of a document have
+ */
+#define LOG_TF_TABLE_SIZE 256
+
+class class_log_tf_table
+{
+public:
+  double values[LOG_TF_TABLE_SIZE];
+
+  class_log_tf_table(void)
+  {
+    for (unsigned int i = 0; i < LOG_TF_TABLE_SIZE; i++) {
+      values[i] = 1 + log(static_cast<double>(i));
+    }
+  }
+};
+
+static inline double log_tf(double count)
+{
+  static const class_log_tf_table table;
+
+  if (count >= 0 && count < LOG_TF_TABLE_SIZE) { // The cast is defined
+    unsigned int i = static_cast<unsigned int>(count);
+
+    if (i == count) {
+      return table.values[i];
+    }
+  }
+  return 1 + log(count);
+}
+
+/**
+ * The sum of the squares of the values, which are summed in four interleaved
+ * lanes that are added together at the end. The result does not depend on
+ * whether SIMD instructions are used.
+ */
+static inline double sum_of_squares(const double *values, size_t n)
+{
+  size_t i = 0;
+  double lanes[4];
+
+#if defined(__SSE2__)
+  __m128d lo = _mm_setzero_pd(), hi = _mm_setzero_pd();
+  for (; i + 4 <= n; i += 4) {
+    __m128d a = _mm_loadu_pd(values + i);
+    __m128d b = _mm_loadu_pd(values + i + 2);
+    lo = _mm_add_pd(lo, _mm_mul_pd(a, a));
+    hi = _mm_add_pd(hi, _mm_mul_pd(b, b));
+  }
+  _mm_storeu_pd(lanes, lo);
+  _mm_storeu_pd(lanes + 2, hi);
+#else
+  lanes[0] = lanes[1] = lanes[2] = lanes[3] = 0;
+  for (; i + 4 <= n; i += 4) {
+    for (unsigned int k = 0; k < 4; k++) {
+      lanes[k] += values[i + k] * values[i + k];
+    }
+  }
+#endif
+
+  for (unsigned int k = 0; i < n; i++, k++) {
+    lanes[k] += values[i] * values[i];
+  }
+
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+/* Gathers the features of one document as (offset, weight) pairs and turns
+ * them into the record of a w vector file, i.e., the NULL-terminated document
+ * name, Q and the entries sorted by offset. The arrays are kept from one
+ * document to the next so that a document normally costs no allocation.
+ */
+class class_w_vector_builder
+{
+private:
+  vector<uint32_t> offsets;
+  vector<double> weights;
+  vector<uint32_t> sorted_offsets;
+  vector<double> sorted_weights;
+  size_t count;
+  int is_summing_duplicates;
+
+  inline void grow(void)
+  {
+    size_t capacity = offsets.empty() ? 64 : offsets.size() * 2;
+
+    offsets.resize(capacity);
+    weights.resize(capacity);
+    sorted_offsets.resize(capacity);
+    sorted_weights.resize(capacity);
+  }
+
+  /* Stable, so that the features of a word listed twice keep their order */
+  inline void sort_by_offset(void)
+  {
+    if (count <= 32) {
+      for (size_t i = 1; i < count; i++) {
+	uint32_t o = offsets[i];
+	double w = weights[i];
+	size_t j = i;
+
+	for (; j > 0 && offsets[j - 1] > o; j--) {
+	  offsets[j] = offsets[j - 1];
+	  weights[j] = weights[j - 1];
+	}
+	offsets[j] = o;
+	weights[j] = w;
+      }
+      return;
+    }
+
+    uint32_t max = 0;
+    for (size_t i = 0; i < count; i++) {
+      max |= offsets[i];
+    }
+
+    /* One LSD radix pass per significant byte of the offsets */
+    for (unsigned int shift = 0; shift < 32 && (max >> shift) != 0;
+	 shift += 8) {
+      size_t bins[257];
+
+      memset(bins, 0, sizeof(bins));
+      for (size_t i = 0; i < count; i++) {
+	bins[((offsets[i] >> shift) & 0xFF) + 1]++;
+      }
+      for (unsigned int b = 1; b < 257; b++) {
+	bins[b] += bins[b - 1];
+      }
+      for (size_t i = 0; i < count; i++) {
+	size_t j = bins[(offsets[i] >> shift) & 0xFF]++;
+	sorted_offsets[j] = offsets[i];
+	sorted_weights[j] = weights[i];
+      }
+      offsets.swap(sorted_offsets);
+      weights.swap(sorted_weights);
+    }
+  }
+
+  /* The offsets must be sorted */
+  inline void sum_duplicated_offsets(void)
+  {
+    size_t j = 0;
+
+    for (size_t i = 1; i < count; i++) {
+      if (offsets[i] == offsets[j]) {
+	weights[j] += weights[i];
+      } else {
+	j++;
+	offsets[j] = offsets[i];
+	weights[j] = weights[i];
+      }
+    }
+    if (count > 0) {
+      count = j + 1;
+    }
+  }
+
+public:
+  class_w_vector_builder(void) : count(0), is_summing_duplicates(0)
+  {
+  }
+
+  /**
+   * If is_summing is non-zero, the features having the same offset, which
+   * happens with feature hashing, become one feature whose weight is the sum
+   * of theirs. Otherwise, all of them are kept.
+   */
+  inline void sum_duplicates(int is_summing)
+  {
+    is_summing_duplicates = is_summing;
+  }
+
+  inline void add(unsigned int offset, double weight)
+  {
+    if (count == offsets.size()) {
+      grow();
+    }
+    offsets[count] = offset;
+    weights[count] = weight;
+    count++;
+  }
+
+  inline size_t size(void) const
+  {
+    return count;
+  }
+
+  /**
+   * Replace the content of out_buffer with the record of the gathered
+   * features, whose weights are divided by their Euclidean norm if normalize
+   * is non-zero, and forget the features.
+   */
+  inline void build(const char *doc_name, int normalize,
+		    vector<char> &out_buffer)
+  {
+    size_t name_size = strlen(doc_name) + 1;
+    struct sparse_vector_entry entry;
+
+    sort_by_offset();
+    if (is_summing_duplicates) {
+      sum_duplicated_offsets();
+    }
+    unsigned int offset_count = count;
+
+    out_buffer.resize(name_size + sizeof(offset_count)
+		      + count * sizeof(entry));
+    char *out = &out_buffer[0];
+
+    memcpy(out, doc_name, name_size);
+    out += name_size;
+    memcpy(out, &offset_count, sizeof(offset_count));
+    out += sizeof(offset_count);
+
+    double normalizer = 1;
+    if (normalize && count > 0) {
+      normalizer = sqrt(sum_of_squares(&weights[0], count));
+    }
+    for (size_t i = 0; i < count; i++) {
+      entry.offset = offsets[i];
+      entry.value = normalize ? weights[i] / normalizer : weights[i];
+      memcpy(out, &entry, sizeof(entry));
+      out += sizeof(entry);
+    }
+
+    count = 0;
+  }
+};
+
+/* Turns a raw w vector, whose entries are TF'(i, d) = 1 + ln(TF(i, d)) as
+ * output by w_to_vector -t, into the w vector that w_to_vector would have
+ * output using the given IDF_DIC: every entry is multiplied by its IDF, and
+ * the result is divided by its Euclidean norm. The IDF_DIC must have the
+ * offsets of the IDF_DIC the raw w vectors were built with, but its IDF may
+ * come from other documents (e.g., the training set of a fold), and an
+ * offset that none of those documents has is dropped like a word that is
+ * not in the IDF_DIC.
+ */
+class class_w_vector_weighting
+{
+private:
+  const class_idf_dic *idf_dic;
+  vector<uint32_t> offsets;
+  vector<double> weights;
+
+public:
+  class_w_vector_weighting(void) : idf_dic(NULL)
+  {
+  }
+
+  inline void init(const class_idf_dic *idf_dic)
+  {
+    this->idf_dic = idf_dic;
+  }
+
+  /* Add the entries of a raw w vector in the order of their offsets */
+  inline void add(unsigned int offset, double tf)
+  {
+    if (offset >= idf_dic->size()) {
+      fatal_error("Offset %u of a raw w vector is beyond the IDF_DIC (%lu)",
+		  offset, static_cast<unsigned long>(idf_dic->size()));
+    }
+    if (idf_dic->doc_count(offset) == 0) {
+      return;
+    }
+
+    offsets.push_back(offset);
+    weights.push_back(tf * idf_dic->idf(offset));
+  }
+
+  /* Put the weighted entries into w and forget them */
+  inline void output(class_sparse_vector &w)
+  {
+    if (!weights.empty()) {
+      double normalizer = sqrt(sum_of_squares(&weights[0], weights.size()));
+
+      for (size_t i = 0; i < weights.size(); i++) {
+	w[offsets[i]] = weights[i] / normalizer;
+      }
+    }
+
+    offsets.clear();
+    weights.clear();
+  }
+};
+
+#endif /* UTILITY_W_VECTOR_HPP */
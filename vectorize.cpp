@@ -0,0 +1,339 @@
+/*****************************************************************************
+ * Copyright (C) 2011  Tadeus Prastowo (eus@member.fsf.org)                  *
+ *                                                                           *
+ * This program is free software: you can redistribute it and/or modify      *
+ * it under the terms of the GNU General Public License as published by      *
+ * the Free Software Foundation, either version 3 of the License, or         *
+ * (at your option) any later version.                                       *
+ *                                                                           *
+ * This program is distributed in the hope that it will be useful,           *
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of            *
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the             *
+ * GNU General Public License for more details.                              *
+ *                                                                           *
+ * You should have received a copy of the GNU General Public License         *
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
+ *****************************************************************************/
+
+#include <vector>
+#include <list>
+#include <algorithm>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include "utility.h"
+#include "utility.hpp"
+#include "utility_span.hpp"
+#include "utility_tf.hpp"
+#include "utility_container.hpp"
+#include "utility_term_counter.hpp"
+#include "utility_idf_dic.hpp"
+#include "utility_w_vector.hpp"
+#include "utility_prefetch.hpp"
+#include "utility_content_hash.hpp"
+
+using namespace std;
+
+static char *buffer = NULL;
+CLEANUP_BEGIN
+{
+  if (buffer != NULL) {
+    free(buffer);
+  }
+} CLEANUP_END
+
+/* Phase one: every word is interned once, and its index in the counter,
+ * whose count is the doc_count of the word, stands for the word from then on.
+ * A document is kept as its name and the run of its (term id, TF') pairs,
+ * which are split into two arrays to keep them compact.
+ */
+static class_term_counter terms;
+struct doc {
+  size_t name; /* of the NULL-terminated name in doc_names */
+  size_t first_tf; /* the index of the first pair of the document */
+  size_t tf_count;
+};
+static vector<struct doc> docs;
+static vector<char> doc_names;
+static vector<unsigned int> tf_ids;
+static vector<double> tf_weights; /* TF'(i, d) = 1 + ln(TF(i, d)) */
+static unsigned long M = 0;
+
+static inline void tf_fn(const char *f, size_t length, double count)
+{
+  tf_ids.push_back(terms.add(f, length));
+  tf_weights.push_back(log_tf(count));
+}
+
+static inline void begin_doc(const char *doc_name)
+{
+  struct doc d;
+
+  d.name = doc_names.size();
+  d.first_tf = tf_ids.size();
+  d.tf_count = 0;
+  docs.push_back(d);
+  doc_names.insert(doc_names.end(), doc_name, doc_name + strlen(doc_name) + 1);
+  M++;
+}
+
+static inline void end_doc(void)
+{
+  docs.back().tf_count = tf_ids.size() - docs.back().first_tf;
+}
+
+/* With the option -u, a document whose TF bytes are the same as those of an
+ * earlier one shares the pairs of the earlier one instead of being parsed,
+ * and only the doc_count of its words is counted again. The bytes of the
+ * first document having a key are kept to tell a copy from a collision.
+ */
+static int dedup = 0;
+struct first_doc {
+  size_t doc; /* the index in docs */
+  size_t bytes; /* the offset of its TF bytes in first_doc_bytes */
+};
+static unordered_map<struct content_key, struct first_doc,
+		     content_key_hash> doc_of_content;
+static vector<char> first_doc_bytes;
+
+static inline void add_doc(const char *doc_name, const char *tf, size_t length,
+			   const char *tf_name)
+{
+  if (dedup) {
+    struct first_doc first;
+
+    first.doc = docs.size();
+    first.bytes = first_doc_bytes.size();
+
+    pair<unordered_map<struct content_key, struct first_doc,
+		       content_key_hash>::iterator, bool> slot
+      = doc_of_content.insert(make_pair(content_key_of(tf, length), first));
+
+    if (slot.second) {
+      first_doc_bytes.insert(first_doc_bytes.end(), tf, tf + length);
+    } else if (length == 0
+	       || memcmp(&first_doc_bytes[slot.first->second.bytes], tf,
+			 length) == 0) {
+      struct doc original = docs[slot.first->second.doc];
+
+      begin_doc(doc_name);
+      docs.back().first_tf = original.first_tf;
+      docs.back().tf_count = original.tf_count;
+      for (size_t i = 0; i < original.tf_count; i++) {
+	terms.add_count(tf_ids[original.first_tf + i], 1);
+      }
+      return;
+    }
+  }
+
+  begin_doc(doc_name);
+  parse_tf_data(tf, length, tf_name, 1, tf_fn);
+  end_doc();
+}
+
+static inline void record_fn(const char *doc_name, const char *tf,
+			     size_t length)
+{
+  add_doc(doc_name, tf, length, doc_name);
+}
+
+/* With -u, a TF file in the list is read whole to be hashed */
+static inline void add_loaded_doc(const char *path)
+{
+  struct input_context ctx;
+  void *map;
+  size_t map_length = 0, length;
+  const char *data;
+
+  init_input_context(&ctx, in_stream, in_stream_name, buffer, BUFFER_SIZE);
+  data = load_in_stream(&ctx, &length, &map, &map_length);
+  add_doc(get_file_name(path), data, length, path);
+  release_in_stream(&ctx, map, map_length);
+  destroy_input_context(&ctx);
+}
+
+/* Phase two: the offset of every kept term is decided as idf_dic does, and
+ * the IDF_DIC and the w vectors are output from memory
+ */
+static const char *idf_dic_path = NULL;
+static int is_frequency_ordered = 0;
+static unsigned int min_df = 1;
+static unsigned int max_df = ~0U;
+
+#define NOT_KEPT (~0U)
+static vector<unsigned int> offsets; /* indexed by term id */
+static vector<double> idfs; /* indexed by offset */
+
+static vector<class_span> term_spans;
+
+static bool word_order(unsigned int a, unsigned int b)
+{
+  return term_spans[a] < term_spans[b];
+}
+
+static bool more_frequent(unsigned int a, unsigned int b)
+{
+  return terms.get(a).count > terms.get(b).count;
+}
+
+static inline void output_idf_dic(void)
+{
+  vector<unsigned int> order;
+  class_idf_dic_writer writer;
+
+  term_spans.resize(terms.size());
+  for (unsigned int i = 0; i < terms.size(); i++) {
+    const class_term_counter::term &t = terms.get(i);
+
+    term_spans[i] = class_span(terms.name(t), t.length);
+    if (t.count >= min_df && t.count <= max_df) {
+      order.push_back(i);
+    }
+  }
+
+  sort(order.begin(), order.end(), word_order);
+  if (is_frequency_ordered) {
+    stable_sort(order.begin(), order.end(), more_frequent);
+  }
+
+  offsets.assign(terms.size(), NOT_KEPT);
+  idfs.resize(order.size());
+  for (unsigned int i = 0; i < order.size(); i++) {
+    const class_term_counter::term &t = terms.get(order[i]);
+
+    offsets[order[i]] = i;
+    idfs[i] = log(static_cast<double>(M) / t.count);
+    writer.add(terms.name(t), t.length, idfs[i], t.count);
+  }
+
+  FILE *out = open_local_out_stream(idf_dic_path);
+  writer.output(out, M);
+  close_local_out_stream(out, idf_dic_path);
+}
+
+static inline void output_w_vectors(void)
+{
+  class_w_vector_builder builder;
+  vector<char> w_vector;
+  const unsigned int dic_size = idfs.size();
+
+  if (fwrite(&dic_size, sizeof(dic_size), 1, out_stream) == 0) {
+    fatal_syserror("Cannot write normal vector size to output stream");
+  }
+
+  for (size_t d = 0; d < docs.size(); d++) {
+    size_t end = docs[d].first_tf + docs[d].tf_count;
+
+    for (size_t i = docs[d].first_tf; i < end; i++) {
+      unsigned int offset = offsets[tf_ids[i]];
+
+      if (offset != NOT_KEPT) {
+	builder.add(offset, tf_weights[i] * idfs[offset]);
+      }
+    }
+
+    builder.build(&doc_names[docs[d].name], 1, w_vector);
+    if (fwrite(&w_vector[0], w_vector.size(), 1, out_stream) != 1) {
+      fatal_syserror("Cannot write w vector to output stream");
+    }
+  }
+}
+
+MAIN_BEGIN(
+"vectorize",
+"If input file is not given, stdin is read for a list of paths of input files."
+"\n"
+"Otherwise, the input file is read for such a list.\n"
+"Then, each of the file is expected to be a TF file in either format accepted\n"
+"by the w_to_vector processing unit, and a container of TF files can be given\n"
+"in place of the list or in the list as accepted by the idf_dic processing\n"
+"unit.\n"
+"This processing unit does the work of the idf_dic processing unit followed\n"
+"by that of the w_to_vector processing unit on the same input files while\n"
+"reading and parsing every TF file only once. In the first phase, each word\n"
+"is interned into an integer ID, and each document is kept in memory as a\n"
+"list of (ID, 1 + ln(TF)) pairs while the doc_count of every word is\n"
+"counted. In the second phase, the IDF_DIC in the version 2 format is output\n"
+"to IDF_DIC_FILE given by the option -D, and the w vectors of the input\n"
+"files are output in the format of the w_to_vector processing unit. The\n"
+"results are the same as those of running idf_dic -v 2 and then w_to_vector\n"
+"-D IDF_DIC_FILE on the input files.\n"
+"The options -f, -n, -x and -r are those of the idf_dic processing unit.\n"
+"If the option -u is given, a TF file or record whose bytes are the same as\n"
+"those of an earlier one is not parsed but shares the pairs of the earlier\n"
+"one in memory, while it is still counted as a document of its own. Two TF\n"
+"files having the same length and the same 64-bit xxHash are compared byte\n"
+"by byte to be taken as the same, for which the bytes of every distinct TF\n"
+"file are kept in memory. The results are the same as those without -u.\n"
+"The w vectors are output to the given file if an output file is specified.\n"
+"Otherwise, stdout is used to output binary data.\n",
+"D:fn:x:r:u",
+"-D IDF_DIC_FILE [-f] [-n MIN_DF] [-x MAX_DF] [-r FILE_COUNT] [-u]",
+0,
+case 'D':
+idf_dic_path = optarg;
+break;
+
+case 'f':
+is_frequency_ordered = 1;
+break;
+
+case 'n':
+min_df = strtoul(optarg, NULL, 10);
+break;
+
+case 'x':
+max_df = strtoul(optarg, NULL, 10);
+break;
+
+case 'r': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 0) {
+    fatal_error("FILE_COUNT must be >= 0");
+  }
+  prefetch_window = num;
+}
+break;
+
+case 'u':
+dedup = 1;
+break;
+)
+
+  if (idf_dic_path == NULL) {
+    fatal_error("-D must be specified (-h for help)");
+  }
+
+  /* Allocating tokenizing buffer */
+  buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+  if (buffer == NULL) {
+    fatal_error("Insufficient memory");
+  }
+  /* End of allocation */
+
+MAIN_INPUT_START
+if (parse_container(buffer, BUFFER_SIZE, record_fn)) {
+  /* The input stream is a container */
+} else {
+MAIN_LIST_OF_FILE_START
+{
+  if (parse_container(buffer, BUFFER_SIZE, record_fn)) {
+    /* The file is a container */
+  } else if (dedup) {
+    add_loaded_doc(file_path->c_str());
+  } else {
+    begin_doc(get_file_name(file_path->c_str()));
+    parse_tf(buffer, BUFFER_SIZE, 1, tf_fn);
+    end_doc();
+  }
+}
+MAIN_LIST_OF_FILE_END
+}
+MAIN_INPUT_END
+{
+  output_idf_dic();
+  output_w_vectors();
+}
+MAIN_END
@@ -15,9 +15,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.     *
  *****************************************************************************/
 
-#include <unordered_set>
-#include <unordered_map>
-#include <string>
+#define THREADED
+
+#include <vector>
 #include <list>
 #include <cstdio>
 #include <cstdlib>
@@ -26,45 +26,260 @@
 #include "utility.h"
 #include "utility_vector.hpp"
 #include "utility.hpp"
+#include "utility_tf.hpp"
+#include "utility_container.hpp"
+#include "utility_idf_dic.hpp"
+#include "utility_thread.hpp"
+#include "utility_w_vector.hpp"
+#include "utility_prefetch.hpp"
 
 using namespace std;
 
+/* What one worker needs to vectorize its share of the TF files in the
+ * threaded mode
+ */
+struct w_worker {
+  char *buffer;
+  struct input_context ctx;
+  class_w_vector_builder builder;
+  vector<char> w_vector;
+  vector<char> record; /* of a container in the list */
+};
+
+/* A container given in place of the list of TF files is mapped whole so that
+ * its records can be spread among the workers
+ */
+struct mapped_container {
+  struct input_context ctx;
+  void *map;
+  size_t map_length;
+  class_container_reader reader;
+};
+
 static char *buffer = NULL;
+static struct w_worker *workers = NULL;
+static unsigned int worker_count = 1;
+static list<struct mapped_container> containers;
 CLEANUP_BEGIN
 {
   if (buffer != NULL) {
     free(buffer);
   }
+  if (workers != NULL) {
+    for (unsigned int i = 0; i < worker_count; i++) {
+      free(workers[i].buffer);
+      destroy_input_context(&workers[i].ctx);
+    }
+    delete [] workers;
+  }
+  for (list<struct mapped_container>::iterator i = containers.begin();
+       i != containers.end(); ++i) {
+    release_in_stream(&i->ctx, i->map, i->map_length);
+    destroy_input_context(&i->ctx);
+  }
 } CLEANUP_END
 
-typedef pair<string, double> class_w_entry;
-typedef list<class_w_entry> class_w_list;
-static class_w_list w_list;
-static string word;
+static class_idf_dic idf_dic;
+static const char *idf_dic_path = NULL;
+
+/* Feature hashing, whose bits is 0 if no feature is hashed */
+static struct idf_dic_feature_hashing hashing = {0, 0};
+static int is_seed_given = 0;
+static int is_signed_hashing = 0;
+
+/* With the option -t, neither the IDF nor the normalization is applied */
+static int is_raw = 0;
+
+/* With feature hashing, a word hashed to an offset that no document had when
+ * the hashed IDF_DIC was built is dropped like a word not in the dictionary
+ */
+static inline void hashed_tf_fn_r(class_w_vector_builder *b,
+				  const char *f, size_t length, double count)
+{
+  uint64_t hash = feature_hash_value(hashing.seed, f, length);
+  unsigned int pos = feature_hash_offset(hash, hashing.bits);
+  double w = log_tf(count);
+
+  if (idf_dic_path != NULL && !is_raw) {
+    if (idf_dic.doc_count(pos) == 0) {
+      return;
+    }
+    w *= idf_dic.idf(pos);
+  }
+
+  if (is_signed_hashing && feature_hash_is_negative(hash)) {
+    w = -w;
+  }
+
+  b->add(pos, w);
+}
+
+/* Calculation of a feature's weight */
+static void tf_fn_r(const char *f, size_t length, double count, void *arg)
+{
+  class_w_vector_builder *b = static_cast<class_w_vector_builder *>(arg);
+  unsigned int pos;
+
+  if (hashing.bits != 0) {
+    hashed_tf_fn_r(b, f, length, count);
+    return;
+  }
+
+  if (!idf_dic.find(f, length, &pos)) { // Word is not in the dictionary
+    return;
+  }
+
+  if (is_raw) {
+    b->add(pos, log_tf(count));
+  } else if (idf_dic.doc_count(pos) != 0) { // Not held out by idf_dic -B
+    b->add(pos, log_tf(count) * idf_dic.idf(pos));
+  }
+}
+
+static inline void write_w_vector(const vector<char> &w_vector)
+{
+  if (fwrite(&w_vector[0], w_vector.size(), 1, out_stream) != 1) {
+    fatal_syserror("Cannot write w vector to output stream");
+  }
+}
+
+static class_w_vector_builder builder;
+static vector<char> w_vector;
+
+static inline void tf_fn(const char *f, size_t length, double count)
+{
+  tf_fn_r(f, length, count, &builder);
+}
+
+static inline void record_fn(const char *doc_name, const char *tf,
+			     size_t length)
+{
+  parse_tf_data(tf, length, doc_name, 1, tf_fn);
+  builder.build(doc_name, !is_raw, w_vector);
+  write_w_vector(w_vector);
+}
+
+/* Either a TF file or a record of a container */
+struct w_job {
+  const char *path;
+  const class_container_reader *container;
+  size_t record;
+};
+static vector<struct w_job> jobs;
+static class_reorder_buffer w_vectors;
 
-static inline void partial_fn(char *f)
+/* The w vectors of the records of a container in the list are output as the
+ * result of the one job of the container
+ */
+static void vectorize_record(const char *doc_name, const char *tf,
+			     size_t length, void *arg)
 {
-  word.append(f);
+  struct w_worker *w = static_cast<struct w_worker *>(arg);
+
+  parse_tf_data_r(tf, length, doc_name, 1, tf_fn_r, &w->builder);
+  w->builder.build(doc_name, !is_raw, w->record);
+  w->w_vector.insert(w->w_vector.end(), w->record.begin(), w->record.end());
 }
 
-static inline void complete_fn(void)
+/* A file in the list is found to be a container only once it is opened by
+ * the worker vectorizing it
+ */
+static void vectorize(size_t job, unsigned int worker, void *arg)
 {
-  unsigned int pos = word.find(' ');
+  struct w_worker *w = &workers[worker];
+  const struct w_job &j = jobs[job];
 
-  if (pos == word.npos) {
-    fatal_error("%s is a malformed input", word.c_str());
+  if (j.container == NULL) {
+    open_input_context(&w->ctx, j.path);
+    w->w_vector.clear();
+    if (!parse_container_r(&w->ctx, vectorize_record, w)) {
+      parse_tf_r(&w->ctx, 1, tf_fn_r, &w->builder);
+      w->builder.build(get_file_name(j.path), !is_raw, w->w_vector);
+    }
+    close_input_context(&w->ctx);
   } else {
-    w_list.push_back(class_w_entry());
+    const char *doc_name;
+    const char *tf;
+    size_t length;
 
-    class_w_entry &e = w_list.back();
-    e.first.append(word.substr(0, pos));
-    e.second = strtod(word.substr(pos + 1).c_str(), NULL);
+    j.container->get(j.record, &doc_name, &tf, &length);
+    parse_tf_data_r(tf, length, doc_name, 1, tf_fn_r, &w->builder);
+    w->builder.build(doc_name, !is_raw, w->w_vector);
   }
 
-  word.clear();
+  w_vectors.submit(job, w->w_vector);
 }
 
-#include "utility_idf_dic.hpp"
+static void write_w_vector_fn(size_t job, const vector<char> &w_vector,
+			      void *arg)
+{
+  if (!w_vector.empty()) { // A container may have no record
+    write_w_vector(w_vector);
+  }
+}
+
+/* The whole list is read first, or the records of the container that
+ * in_stream is are spread among the workers like the TF files are. No file in
+ * the list is opened here.
+ */
+static inline void list_w_jobs(void)
+{
+  struct w_job job;
+
+  job.path = NULL;
+  job.container = NULL;
+  job.record = 0;
+
+  if (!in_stream_has_magic(in_stream, CONTAINER_MAGIC, CONTAINER_MAGIC_SIZE)) {
+    tokenizer("\n", buffer, BUFFER_SIZE, partial_fn_file, complete_fn_file);
+    for (class_input_file_paths::iterator path = input_file_paths.begin();
+	 path != input_file_paths.end(); ++path) {
+      job.path = path->c_str();
+      jobs.push_back(job);
+    }
+    return;
+  }
+
+  struct mapped_container c;
+  size_t length;
+  const char *data;
+
+  init_input_context(&c.ctx, in_stream, in_stream_name, buffer, BUFFER_SIZE);
+  data = load_in_stream(&c.ctx, &length, &c.map, &c.map_length);
+  containers.push_back(c);
+  containers.back().reader.open(data, length, in_stream_name);
+
+  job.container = &containers.back().reader;
+  for (size_t i = 0; i < job.container->size(); i++) {
+    job.record = i;
+    jobs.push_back(job);
+  }
+}
+
+/* Vectorize the documents using worker_count threads and output the w vectors
+ * in the order of the list
+ */
+static inline void threaded_w_vectors(void)
+{
+  list_w_jobs();
+
+  workers = new struct w_worker[worker_count];
+  for (unsigned int i = 0; i < worker_count; i++) {
+    workers[i].buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+    if (workers[i].buffer == NULL) {
+      fatal_error("Insufficient memory");
+    }
+    init_input_context(&workers[i].ctx, NULL, NULL,
+		       workers[i].buffer, BUFFER_SIZE);
+    workers[i].builder.sum_duplicates(hashing.bits != 0);
+  }
+
+  w_vectors.init(REORDER_WINDOW_PER_WORKER * worker_count, write_w_vector_fn,
+		 NULL);
+
+  class_worker_pool pool;
+  pool.run(worker_count, jobs.size(), vectorize, NULL);
+}
 
 MAIN_BEGIN(
 "w_to_vector",
@@ -73,24 +288,36 @@ MAIN_BEGIN(
 "Otherwise, the input file is read for such a list.\n"
 "Then, each of the file in the list is expected to have the following form:\n"
 "WORD WORD_COUNT\\n\n"
+"or to be in the binary TF format produced by the TF processing unit with\n"
+"option -b, which is detected automatically.\n"
+"A container of TF files produced by the TF processing unit with option -C\n"
+"can be given either as the input file, which must then be a regular file,\n"
+"in place of the list or as a file in the list. Each of its records is then\n"
+"taken as one TF file named after the record.\n"
 "Logically, each file should come from a TF processing unit in which\n"
 "each TF processing unit produces a list of unique words in a document.\n"
-"The mandatory option -D specifies the name of the IDF_DIC file generated\n"
-"by the idf_dic processing unit whose expected structure is as follows:\n"
-"+----------------------------------------------------------+\n"
-"| Normal vector size of the sparse vector in unsigned int  |\n"
-"| (4 bytes): should be 1                                   |\n"
-"+--------------------------------------+---+-------+-------+\n"
-"| NULL-terminated sorted unique word 1 | Q | off_1 | IDF_1 |\n"
-"+--------------------------------------+---+-------+-------+\n"
-"|                             ...                          |\n"
-"+--------------------------------------+---+-------+-------+\n"
-"| NULL-terminated sorted unique word N | Q | off_N | IDF_N |\n"
-"+--------------------------------------+---+-------+-------+\n"
-"The binary data endianness is expected to be that of the host machine.\n"
-"Q is an unsigned int (4 bytes) datum whose value should be 1.\n"
-"off_i is an unsigned int (4 bytes) datum whose value must be 0.\n"
-"IDF_i is a double (8 bytes) datum whose value should be the IDF of word i.\n"
+"The option -D specifies the name of the IDF_DIC file generated\n"
+"by the idf_dic processing unit in either format (see idf_dic -h). The\n"
+"version 2 format is used in place once memory-mapped.\n"
+"If the IDF_DIC is hashed (see idf_dic -h), or if the option -H is given,\n"
+"no word is looked up. Instead, every word is hashed to an offset in\n"
+"[0, 2^BITS) like idf_dic does with -H, and the weights of the words of a\n"
+"document hashed to the same offset are added up. BITS and SEED, which is\n"
+"given by the option -e, come from a hashed IDF_DIC and must match it if\n"
+"given. Without -D, IDF(i) is taken as 1 and SEED defaults to 0. A word\n"
+"having a doc_count of 0 (see idf_dic -B), or hashed to an offset having a\n"
+"doc_count of 0, is dropped like a word not in the dictionary is unless -t\n"
+"is given. If the option -g is given, the weight of a word is negated when\n"
+"the highest bit of its hash is set (signed hashing) so that the collisions\n"
+"tend to cancel out.\n"
+"Either -D or -H must be given.\n"
+"If the option -t is given, the output is raw w vectors: the weight of a\n"
+"word is only TF'(i, d) below, and the vector is not normalized, while the\n"
+"offsets are still those given by the IDF_DIC. Since the raw w vector of a\n"
+"document does not depend on the other documents, the raw w vectors can be\n"
+"built once per corpus and then turned into w vectors by the rocchio and\n"
+"classifier processing units given an IDF_DIC having the same offsets using\n"
+"their option -W, for example, an IDF_DIC of the training set of a fold.\n"
 "Then, this processing unit will calculate the weight vector w of each\n"
 "document: w^d = <w^d_1, ..., w^d_N> where\n"
 "                        TF'(i, d) * IDF(i)\n"
@@ -118,82 +345,121 @@ MAIN_BEGIN(
 "account because the duplicates are assumed to be the copy of the first\n "
 "document and so will have the same vector representation w.\n"
 "The result is output to the given file if an output file is specified.\n"
-"Otherwise, stdout is used to output binary data.\n",
-"D:",
-"-D IDF_DIC_FILE",
+"Otherwise, stdout is used to output binary data.\n"
+"If the option -J is given with THREAD_COUNT > 1, the input files are split\n"
+"among that many threads each of which has its own buffers, and the w\n"
+"vectors are output in the order of the list so that the result is the same.\n"
+"In this mode, the whole list is read first. The records of a container given\n"
+"in place of the list are split among the threads as well while a container\n"
+"in the list is vectorized by one thread.\n"
+"Without -J, up to FILE_COUNT files after the one being vectorized are\n"
+"opened ahead by at most 16 other threads, which also read them whole into\n"
+"the page cache. FILE_COUNT is given by the option -r and defaults to 8 when\n"
+"more than one processor is online, or 0 otherwise, with which every file is\n"
+"opened only when it is vectorized. The result is the same.\n",
+"D:J:H:e:gr:t",
+"-D IDF_DIC_FILE | -H BITS [-e SEED] [-g] [-t] [-J THREAD_COUNT]\n"
+" [-r FILE_COUNT]",
 0,
-case 'D':
-/* Allocating tokenizing buffer */
-buffer = static_cast<char *>(malloc(BUFFER_SIZE));
-if (buffer == NULL) {
-  fatal_error("Insufficient memory");
- }
-/* End of allocation */
-
-load_idf_dic_file(optarg);
-break;
-)
-
-  if (buffer == NULL) {
-    fatal_error("-D must be specified (-h for help)");
+case 'H': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1 || num > FEATURE_HASHING_MAX_BITS) {
+    fatal_error("BITS must be in [1, %u]", FEATURE_HASHING_MAX_BITS);
   }
+  hashing.bits = num;
+}
+break;
 
-  const unsigned int dic_size = idf_list.size();
-  if (fwrite(&dic_size, sizeof(dic_size), 1, out_stream) == 0) {
-    fatal_syserror("Cannot write normal vector size to output stream");
-  }
-
-  list<class_idf_entry> valid_w_list;
-
-MAIN_INPUT_START
-MAIN_LIST_OF_FILE_START
-{
-  const string doc_name(get_file_name(file_path->c_str()));
-
-  tokenizer("\n", buffer, BUFFER_SIZE, partial_fn, complete_fn);
+case 'e':
+hashing.seed = strtoul(optarg, NULL, 10);
+is_seed_given = 1;
+break;
 
-  double normalizer = 0;
-  for (class_w_list::iterator i = w_list.begin(); i != w_list.end(); i++) {
+case 'g':
+is_signed_hashing = 1;
+break;
 
-    class_idf_list::iterator j = idf_list.find(i->first);
+case 't':
+is_raw = 1;
+break;
 
-    if (j == idf_list.end()) { // Word is not in the dictionary
-      continue;
-    } else { // Calculation of a feature's weight
-      unsigned int pos = j->second.first;
-      double tf_idf = (1 + log(i->second)) * j->second.second;
+case 'J': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 1) {
+    fatal_error("THREAD_COUNT must be >= 1");
+  }
+  worker_count = num;
+}
+break;
 
-      valid_w_list.push_back(class_idf_entry(pos, tf_idf));
-      normalizer += tf_idf * tf_idf;
-    }
+case 'r': {
+  long int num = (long int) strtoul(optarg, NULL, 10);
+  if (num < 0) {
+    fatal_error("FILE_COUNT must be >= 0");
   }
-  normalizer = sqrt(normalizer);
+  prefetch_window = num;
+}
+break;
 
-  valid_w_list.sort();
+case 'D':
+idf_dic_path = optarg;
+break;
+)
 
-  fprintf(out_stream, "%s%c", doc_name.c_str(), '\0');
+  if (idf_dic_path == NULL && hashing.bits == 0) {
+    fatal_error("-D or -H must be specified (-h for help)");
+  }
 
-  unsigned int offset_count = valid_w_list.size();
-  if (fwrite(&offset_count, sizeof(offset_count), 1, out_stream) == 0) {
-    fatal_syserror("Cannot write offset count to output stream");
+  /* Allocating tokenizing buffer */
+  buffer = static_cast<char *>(malloc(BUFFER_SIZE));
+  if (buffer == NULL) {
+    fatal_error("Insufficient memory");
   }
+  /* End of allocation */
 
-  struct sparse_vector_entry entry;  
-  for (list<class_idf_entry>::iterator i = valid_w_list.begin();
-       i != valid_w_list.end(); i++) {
+  if (idf_dic_path != NULL) {
+    idf_dic.open(idf_dic_path, buffer, BUFFER_SIZE);
 
-    entry.offset = i->first;
-    entry.value = i->second / normalizer;
+    if (idf_dic.is_hashed()) {
+      const struct idf_dic_feature_hashing &h = idf_dic.feature_hashing();
 
-    if (fwrite(&entry, sizeof(entry), 1, out_stream) == 0) {
-      fatal_syserror("Cannot write weight to output stream");
+      if ((hashing.bits != 0 && hashing.bits != h.bits)
+	  || (is_seed_given && hashing.seed != h.seed)) {
+	fatal_error("BITS and SEED must match those of %s (%u and %u)",
+		    idf_dic_path, h.bits, h.seed);
+      }
+      hashing = h;
+    } else if (hashing.bits != 0) {
+      fatal_error("-H cannot be used with %s, which is not hashed",
+		  idf_dic_path);
     }
   }
+  if (is_signed_hashing && hashing.bits == 0) {
+    fatal_error("-g needs feature hashing");
+  }
+  builder.sum_duplicates(hashing.bits != 0);
 
-  valid_w_list.clear();
-  w_list.clear();
-  word.clear();
+  const unsigned int dic_size = (hashing.bits != 0
+				 ? 1U << hashing.bits : idf_dic.size());
+  if (fwrite(&dic_size, sizeof(dic_size), 1, out_stream) == 0) {
+    fatal_syserror("Cannot write normal vector size to output stream");
+  }
+
+MAIN_INPUT_START
+if (worker_count > 1) {
+  threaded_w_vectors();
+} else if (parse_container(buffer, BUFFER_SIZE, record_fn)) {
+  /* The input stream is a container */
+} else {
+MAIN_LIST_OF_FILE_START
+{
+  if (!parse_container(buffer, BUFFER_SIZE, record_fn)) {
+    parse_tf(buffer, BUFFER_SIZE, 1, tf_fn);
+    builder.build(get_file_name(file_path->c_str()), !is_raw, w_vector);
+    write_w_vector(w_vector);
+  }
 }
 MAIN_LIST_OF_FILE_END
+}
 MAIN_INPUT_END
 MAIN_END